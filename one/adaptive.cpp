@@ -0,0 +1,140 @@
+#include "mesh.h"
+#include "extra.h"
+#include "pool.h"
+#include <cmath>
+
+using namespace std;
+
+bool Mesh::_needsRefinement (int fi, float angle, float size, Vector3f eye) const {
+  const Face &f = faces[fi]; 
+  Vector3f p[3], n[3]; 
+  for (int i = 0; i < 3; i++) {
+    p[i] = project(geom.position(f.vs[i])); 
+    n[i] = project(geom.normal(f.vs[i])); 
+  }
+  // curvature: how far apart the normals at the corners are. The
+  // cosines are compared directly, as acos of a dot product rounded
+  // past -1 on a folded face would be NaN and never refine.
+  float cosAngle = cos(angle); 
+  for (int i = 0; i < 3; i++) 
+    if (Vector3f::dot(n[i], n[(i + 1) % 3]) < cosAngle) 
+      return true; 
+  // size: the angle the longest edge subtends as seen from the eye.
+  if (size > 0) {
+    float longest = 0; 
+    for (int i = 0; i < 3; i++) 
+      longest = max(longest, (p[i] - p[(i + 1) % 3]).abs()); 
+    float dist = ((p[0] + p[1] + p[2]) / 3.f - eye).abs(); 
+    if (longest > size * dist) 
+      return true; 
+  }
+  return false; 
+}
+
+int Mesh::adaptiveSubdivide (float angle, float size, Vector3f eye) {
+
+  int nv = vertices.size(), ne = edges.size(), nf = faces.size(); 
+
+  // Faces that fail the test are split in four like in 
+  // loopSubdivide. Every edge of those is split too, and a face
+  // left with two or three split edges is split in four as well,
+  // so that the remaining faces have at most one split edge. Those
+  // are bisected, which closes up the T-junctions. 
+  vector<char> red(nf), split(ne, 0); 
+  parallelFor(nf, [&] (int begin, int end) {
+    for (int f = begin; f < end; f++) 
+      red[f] = _needsRefinement(f, angle, size, eye); 
+  }); 
+  vector<int> work; 
+  for (int f = 0; f < nf; f++) 
+    if (red[f]) 
+      work.push_back(f); 
+  while (!work.empty()) {
+    int f = work.back(); 
+    work.pop_back(); 
+    for (int e : faces[f].es) {
+      if (split[e]) 
+        continue;
+      split[e] = 1; 
+      int g = edges[e].fs[0] == f ? edges[e].fs[1] : edges[e].fs[0]; 
+      int count = split[faces[g].es[0]] + split[faces[g].es[1]] + split[faces[g].es[2]]; 
+      if (!red[g] && count > 1) {
+        red[g] = 1; 
+        work.push_back(g); 
+      }
+    }
+  }
+
+  // Even vertices only move when all the faces around them are
+  // refined, otherwise the coarse faces around them would bend.
+  vector<char> coarse(nv, 0); 
+  for (int f = 0; f < nf; f++) 
+    if (!red[f]) 
+      for (int v : faces[f].vs) 
+        coarse[v] = 1; 
+  vector<int> mid(ne, -1); 
+  int nodd = 0; 
+  for (int e = 0; e < ne; e++) 
+    if (split[e]) 
+      mid[e] = nv + nodd++; 
+  VertexArrays refined; 
+  refined.resize(nv + nodd); 
+  parallelFor(nv, [&] (int begin, int end) {
+    for (int v = begin; v < end; v++) 
+      if (coarse[v]) 
+        refined.set(v, geom.get(v)); 
+      else 
+        _evenGeometry(v, refined, v); 
+  }); 
+  parallelFor(ne, [&] (int begin, int end) {
+    for (int e = begin; e < end; e++) 
+      if (split[e]) 
+        _oddGeometry(e, refined, mid[e]); 
+  }); 
+  refined.normalize(0, nv + nodd); 
+  vector<Vertex> newVertices; 
+  for (int v = 0; v < nv + nodd; v++) 
+    newVertices.emplace_back(v); 
+
+  // Children keep the winding of their parent.
+  vector<Face> newFaces; 
+  int nred = 0; 
+  for (auto &f : faces) {
+    auto add = [&] (Ini vs) { newFaces.push_back(Face(newFaces.size(), vs)); }; 
+    int m[3] = { mid[f.es[0]], mid[f.es[1]], mid[f.es[2]] }; 
+    if (red[f.id]) {
+      nred++; 
+      for (int i = 0; i < 3; i++) 
+        add({ f.vs[i], m[i], m[(i + 2) % 3] }); 
+      add({ m[0], m[1], m[2] }); 
+      continue;
+    }
+    int i = 0; 
+    while (i < 3 && m[i] < 0) 
+      i++; 
+    if (i == 3) {
+      add({ f.vs[0], f.vs[1], f.vs[2] }); 
+    } else {
+      add({ f.vs[i], m[i], f.vs[(i + 2) % 3] }); 
+      add({ m[i], f.vs[(i + 1) % 3], f.vs[(i + 2) % 3] }); 
+    }
+  }
+
+  // Keep the old level aside until the new one validates, and put
+  // it back if it doesn't rather than leave a half-built mesh.
+  vector<Edge> oldEdges; 
+  HalfEdgeMesh oldHalfEdges; 
+  vertices.swap(newVertices); 
+  geom.swap(refined); 
+  faces.swap(newFaces); 
+  edges.swap(oldEdges); 
+  swap(halfEdges, oldHalfEdges); 
+  if (closure()) 
+    return nred; 
+  vertices.swap(newVertices); 
+  geom.swap(refined); 
+  faces.swap(newFaces); 
+  edges.swap(oldEdges); 
+  swap(halfEdges, oldHalfEdges); 
+  return -1; 
+}
@@ -0,0 +1,107 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+#include "curve.h"
+#include "mesh.h"
+#include "pool.h"
+
+using namespace std;
+
+// Times each level of Loop subdivision and reports how much memory
+// it moves per output vertex. 
+//
+//   bench [mesh.obj] [levels]
+//   bench --curves
+//
+// "attrib" counts the position and normal bytes the vertex rules
+// read and write: the one-ring and the vertex itself for an even
+// vertex, four vertices for an odd one, the write, and the pass that
+// normalizes the normals. "total" adds every connectivity array the
+// level reads (the input) or writes (the output).
+//
+// --curves instead times evalBezier with either evaluation mode
+// over a range of steps, and reports how far the forward differenced
+// samples drift from the basis ones.
+
+namespace
+{
+  size_t bytes (const Mesh &m) {
+    size_t b = 6 * sizeof(float) * m.geom.size(); 
+    b += m.vertices.size() * sizeof(Vertex); 
+    for (auto &v : m.vertices) 
+      b += (v.fs.size() + v.es.size()) * sizeof(int); 
+    b += m.faces.size() * sizeof(Face) + m.edges.size() * sizeof(Edge); 
+    const HalfEdgeMesh &he = m.halfEdges; 
+    b += (he.origin.size() + he.twin.size() + he.edge.size() + 
+          he.vertexHalf.size() + he.edgeHalf.size()) * sizeof(int); 
+    return b; 
+  }
+
+  double evalTime (const vector<Vector3f> &P, unsigned steps, CurveEvaluation e, Curve &c) {
+    setCurveEvaluation(e); 
+    int reps = max(1, 4000000 / (int) (P.size() * steps)); 
+    auto t0 = chrono::steady_clock::now(); 
+    for (int r = 0; r < reps; r++) 
+      evalBezier(P, steps, c); 
+    auto t1 = chrono::steady_clock::now(); 
+    return 1e6 * chrono::duration<double, milli>(t1 - t0).count() / (reps * c.size()); 
+  }
+
+  int benchCurves () {
+    // a wavy 3D curve of 64 pieces, about 10 units across
+    vector<Vector3f> P; 
+    for (int i = 0; i <= 3 * 64; i++) 
+      P.push_back(Vector3f(0.05f * i, sinf(0.7f * i), cosf(0.3f * i))); 
+    printf("%6s %14s %14s %12s %12s\n", 
+        "steps", "basis ns/pt", "forward ns/pt", "max |dV|", "max |dT|"); 
+    unsigned steps[] = { 20, 100, 1000, 10000 }; 
+    for (unsigned s : steps) {
+      Curve a, b; 
+      double ta = evalTime(P, s, EVAL_BASIS, a); 
+      double tb = evalTime(P, s, EVAL_FORWARD, b); 
+      float dv = 0, dt = 0; 
+      for (size_t i = 0; i < a.size(); i++) {
+        dv = max(dv, (a[i].V - b[i].V).abs()); 
+        dt = max(dt, (a[i].T - b[i].T).abs()); 
+      }
+      printf("%6u %14.2f %14.2f %12.3g %12.3g\n", s, ta, tb, dv, dt); 
+    }
+    return 0; 
+  }
+}
+
+int main (int argc, char **argv) {
+  if (argc > 1 && !strcmp(argv[1], "--curves")) 
+    return benchCurves(); 
+  const char *file = argc > 1 ? argv[1] : "obj/icosahedron.obj"; 
+  int levels = argc > 2 ? atoi(argv[2]) : 7; 
+  Mesh mesh; 
+  ifstream in(file); 
+  if (!in || !mesh.read(in)) {
+    fprintf(stderr, "can't read %s\n", file); 
+    return 1; 
+  }
+  printf("%d threads\n", ThreadPool::instance().size()); 
+  printf("%5s %10s %10s %10s %12s %14s %13s\n", 
+      "level", "vertices", "faces", "ms", "ns/vertex", "attrib B/vert", "total B/vert"); 
+  const size_t A = 6 * sizeof(float); 
+  for (int l = 1; l <= levels; l++) {
+    size_t nv = mesh.vertices.size(), ne = mesh.edges.size(); 
+    // the one-rings of all the vertices visit every edge twice
+    size_t attrib = A * (nv + 2 * ne) + A * 4 * ne + 3 * A * (nv + ne); 
+    size_t before = bytes(mesh); 
+    auto t0 = chrono::steady_clock::now(); 
+    mesh.loopSubdivide(); 
+    auto t1 = chrono::steady_clock::now(); 
+    double ms = chrono::duration<double, milli>(t1 - t0).count(); 
+    double out = mesh.vertices.size(); 
+    printf("%5d %10zu %10zu %10.2f %12.1f %14.1f %13.1f\n", l, 
+        mesh.vertices.size(), mesh.faces.size(), ms, 1e6 * ms / out, 
+        attrib / out, (before + bytes(mesh)) / out); 
+  }
+  return 0; 
+}
@@ -4,6 +4,9 @@
 #include <windows.h>
 #endif
 #include <GL/gl.h>
+#include <algorithm>
+#include <map>
+#include <mutex>
 using namespace std;
 
 namespace
@@ -33,34 +36,185 @@ const Matrix4f BSPLINE(
     0.f / 6.f,  0.f / 6.f,  0.f / 6.f,  1.f / 6.f
 ); 
 
-void evalBezierAtT (vector<Vector3f> &cp, float t, Vector3f &V, Vector3f &T) {
-  Vector4f p (1.f,   t,   t * t,   t * t * t);
-  Vector4f dp(0.f, 1.f, 2.f * t, 3.f * t * t);
-  Vector4f xs(cp[0].x(), cp[1].x(), cp[2].x(), cp[3].x()); 
-  Vector4f ys(cp[0].y(), cp[1].y(), cp[2].y(), cp[3].y()); 
-  Vector4f zs(cp[0].z(), cp[1].z(), cp[2].z(), cp[3].z()); 
-  V = Vector3f(
-    Vector4f::dot(xs, BERNSTEIN * p), 
-    Vector4f::dot(ys, BERNSTEIN * p), 
-    Vector4f::dot(zs, BERNSTEIN * p)
-  ); 
-  T = Vector3f(
-    Vector4f::dot(xs, BERNSTEIN * dp), 
-    Vector4f::dot(ys, BERNSTEIN * dp), 
-    Vector4f::dot(zs, BERNSTEIN * dp)
-  ); 
-  T.normalize();
+// Maps four B-spline control points to the four Bezier control
+// points of the same piece.
+const Matrix4f BSP2BEZ = (BSPLINE * BERNSTEIN.inverse()).transposed(); 
+
+namespace
+{
+  // Weights of the four control points of a Bezier piece (w) and of
+  // their derivative (dw) at t = k / steps, four floats per sample.
+  struct BezierBasis
+  {
+    vector<float> w, dw; 
+  };
+
+  // The Bernstein weights and their derivatives at t.
+  void bezierWeights( float t, float *w, float *dw )
+  {
+    Vector4f b  = BERNSTEIN * Vector4f(1.f,   t,   t * t,   t * t * t); 
+    Vector4f db = BERNSTEIN * Vector4f(0.f, 1.f, 2.f * t, 3.f * t * t); 
+    for (int j = 0; j < 4; j++) {
+      w[j] = b[j]; 
+      dw[j] = db[j]; 
+    }
+  }
+
+  // The tables for a given steps are built once and shared, as every
+  // piece of every curve with that resolution samples the same t's.
+  // Curves are tessellated in parallel, so the cache is locked; 
+  // evalBezier looks the table up once per curve, not per piece.
+  const BezierBasis &bezierBasis( unsigned steps )
+  {
+    static map<unsigned, BezierBasis> cache; 
+    static mutex lock; 
+    lock_guard<mutex> guard(lock); 
+    auto it = cache.find(steps); 
+    if (it != cache.end()) 
+      return it->second; 
+    BezierBasis &b = cache[steps]; 
+    b.w.resize(4 * (steps + 1)); 
+    b.dw.resize(4 * (steps + 1)); 
+    for (unsigned k = 0; k <= steps; k++) 
+      bezierWeights((0.f + k) / (0.f + steps), &b.w[4 * k], &b.dw[4 * k]); 
+    return b; 
+  }
+
+  // V and (unit) T of the piece cp[0..3] from the weights at one t.
+  void evalWeights( const Vector3f *cp, const float *w, const float *dw, CurvePoint &out )
+  {
+    for (int d = 0; d < 3; d++) {
+      out.V[d] = cp[0][d] * w[0] + cp[1][d] * w[1] + cp[2][d] * w[2] + cp[3][d] * w[3]; 
+      out.T[d] = cp[0][d] * dw[0] + cp[1][d] * dw[1] + cp[2][d] * dw[2] + cp[3][d] * dw[3]; 
+    }
+    out.T.normalize(); 
+  }
+}
+
+namespace
+{
+  CurveEvaluation evaluation = EVAL_BASIS; 
+  float tolerance = 0.f; 
+}
+
+void setCurveEvaluation( CurveEvaluation e )
+{
+  evaluation = e; 
+}
+
+void setCurveTolerance( float tol )
+{
+  tolerance = tol; 
+}
+
+namespace
+{
+  // V and (unit) T at the steps + 1 samples of the piece cp[0..3],
+  // weighing the control points by the cached basis.
+  void basisPiece( const Vector3f *cp, const BezierBasis &basis, unsigned steps, CurvePoint *out )
+  {
+    for (int k = 0; k <= (int) steps; k++) 
+      evalWeights(cp, &basis.w[4 * k], &basis.dw[4 * k], out[k]); 
+  }
+
+  // The same by forward differences of the power basis form
+  // a + bt + ct^2 + et^3 and its derivative: three adds per
+  // coordinate for V and two for T. The differences are kept in
+  // double, which holds the drift at 10,000 steps to about 1e-12 of
+  // the piece's size, and every piece starts again from its own
+  // control points.
+  void forwardPiece( const Vector3f *cp, unsigned steps, CurvePoint *out )
+  {
+    double h = 1.0 / steps; 
+    double V[3], dV[3], ddV[3], dddV[3], T[3], dT[3], ddT[3]; 
+    for (int d = 0; d < 3; d++) {
+      double p0 = cp[0][d], p1 = cp[1][d], p2 = cp[2][d], p3 = cp[3][d]; 
+      double a = p0; 
+      double b = 3 * (p1 - p0); 
+      double c = 3 * (p0 - 2 * p1 + p2); 
+      double e = p3 - p0 + 3 * (p1 - p2); 
+      V[d] = a; 
+      dV[d] = (b + (c + e * h) * h) * h; 
+      ddV[d] = (2 * c + 6 * e * h) * h * h; 
+      dddV[d] = 6 * e * h * h * h; 
+      T[d] = b; 
+      dT[d] = (2 * c + 3 * e * h) * h; 
+      ddT[d] = 6 * e * h * h; 
+    }
+    for (int k = 0; k <= (int) steps; k++) {
+      for (int d = 0; d < 3; d++) {
+        out[k].V[d] = V[d]; 
+        out[k].T[d] = T[d]; 
+        V[d] += dV[d]; 
+        dV[d] += ddV[d]; 
+        ddV[d] += dddV[d]; 
+        T[d] += dT[d]; 
+        dT[d] += ddT[d]; 
+      }
+      out[k].T.normalize(); 
+    }
+  }
+
+  // Deepest split of a piece in adaptive mode, ie. at most 1024
+  // segments, in case the tolerance is far below float precision.
+  const int MAX_FLATTEN_DEPTH = 10; 
+
+  // Distance from p to the segment ab.
+  float chordDistance( const Vector3f &p, const Vector3f &a, const Vector3f &b )
+  {
+    Vector3f ab = b - a; 
+    float l2 = ab.absSquared(); 
+    float t = l2 > 0.f ? Vector3f::dot(p - a, ab) / l2 : 0.f; 
+    t = min(1.f, max(0.f, t)); 
+    return (p - (a + t * ab)).abs(); 
+  }
+
+  // Appends the parameters in (t0, t1] that sample the part q[0..3]
+  // of a piece (spanning [t0, t1] of it) to within tolerance. The
+  // part lies in the hull of q, so once q[1] and q[2] are within
+  // tolerance of the chord, so is the curve, and the chord is kept.
+  // Otherwise the part is split in half by de Casteljau.
+  void flatten( const Vector3f *q, float t0, float t1, int depth, vector<float> &ts )
+  {
+    if (depth == MAX_FLATTEN_DEPTH || 
+        max(chordDistance(q[1], q[0], q[3]), chordDistance(q[2], q[0], q[3])) <= tolerance) {
+      ts.push_back(t1); 
+      return; 
+    }
+    Vector3f q01 = 0.5f * (q[0] + q[1]), q12 = 0.5f * (q[1] + q[2]), q23 = 0.5f * (q[2] + q[3]); 
+    Vector3f q012 = 0.5f * (q01 + q12), q123 = 0.5f * (q12 + q23); 
+    Vector3f m = 0.5f * (q012 + q123); 
+    Vector3f l[4] = { q[0], q01, q012, m }; 
+    Vector3f r[4] = { m, q123, q23, q[3] }; 
+    float tm = 0.5f * (t0 + t1); 
+    flatten(l, t0, tm, depth + 1, ts); 
+    flatten(r, tm, t1, depth + 1, ts); 
+  }
+
+  // Appends the samples of the piece cp[0..3], both ends included,
+  // spaced so that the polyline is within tolerance of the curve.
+  void adaptivePiece( const Vector3f *cp, Curve &c, vector<float> &ts )
+  {
+    ts.assign(1, 0.f); 
+    flatten(cp, 0.f, 1.f, 0, ts); 
+    float w[4], dw[4]; 
+    for (float t : ts) {
+      bezierWeights(t, w, dw); 
+      c.emplace_back(); 
+      evalWeights(cp, w, dw, c.back()); 
+    }
+  }
 }
 
 void bsp2bez (const vector<Vector3f> &bsp, vector<Vector3f> &bez) {
+  bez.reserve(bez.size() + 3 * (bsp.size() - 3) + 1); 
   for (int i = 0; i + 3 < (int) bsp.size(); i++) {
     Vector4f gx(bsp[i][0], bsp[i + 1][0], bsp[i + 2][0], bsp[i + 3][0]); 
     Vector4f gy(bsp[i][1], bsp[i + 1][1], bsp[i + 2][1], bsp[i + 3][1]); 
     Vector4f gz(bsp[i][2], bsp[i + 1][2], bsp[i + 2][2], bsp[i + 3][2]); 
-    auto M = (BSPLINE * BERNSTEIN.inverse()).transposed(); 
-    Vector4f nx = M * gx; 
-    Vector4f ny = M * gy; 
-    Vector4f nz = M * gz; 
+    Vector4f nx = BSP2BEZ * gx; 
+    Vector4f ny = BSP2BEZ * gy; 
+    Vector4f nz = BSP2BEZ * gz; 
     if (i == 0) 
       bez.push_back(Vector3f(nx.x(), ny.x(), nz.x())); 
     for (int j = 1; j < 4; j++) 
@@ -87,7 +241,23 @@ void rectifyNormal (Curve &c) {
   }
 }
 
-Curve evalBezier( const vector< Vector3f >& P, unsigned steps )
+namespace
+{
+  // Frames are carried along the curve, starting from a binormal of
+  // +z: each point's normal is the previous binormal crossed with its
+  // tangent, and its binormal completes the frame.
+  void computeFrames( Curve &c )
+  {
+    Vector3f B(0.f, 0.f, 1.f); 
+    for (auto &pt: c) {
+      pt.N = Vector3f::cross(B, pt.T).normalized(); 
+      pt.B = B = Vector3f::cross(pt.T, pt.N).normalized(); 
+    }
+    rectifyNormal(c); 
+  }
+}
+
+void evalBezier( const vector< Vector3f >& P, unsigned steps, Curve &c )
 {
   // Check
   if( P.size() < 4 || P.size() % 3 != 1 )
@@ -96,64 +266,38 @@ Curve evalBezier( const vector< Vector3f >& P, unsigned steps )
     exit( 0 );
   }
 
-  // You should implement this function so that it returns a Curve
-  // (e.g., a vector< CurvePoint >).  The variable "steps" tells you
-  // the number of points to generate on each piece of the spline.
-  // At least, that's how the sample solution is implemented and how
-  // the SWP files are written.  But you are free to interpret this
-  // variable however you want, so long as you can control the
-  // "resolution" of the discretized spline curve with it.
-
-  // Make sure that this function computes all the appropriate
-  // Vector3fs for each CurvePoint: V,T,N,B.
-  // [NBT] should be unit and orthogonal.
-
-  // Also note that you may assume that all Bezier curves that you
-  // receive have G1 continuity.  Otherwise, the TNB will not be
-  // be defined at points where this does not hold.
-
-  cerr << "\t>>> evalBezier has been called with the following input:" << endl;
-
-  cerr << "\t>>> Control points (type vector< Vector3f >): "<< endl;
-  for( unsigned i = 0; i < P.size(); ++i )
-  {
-    cerr << "\t>>> ";
-    P[i].print();
-    cerr << endl;
+  // Every piece gets its own samples, so the joints appear twice.
+  int np = (P.size() - 1) / 3; 
+  if (tolerance > 0.f) {
+    vector<float> ts; 
+    c.clear(); 
+    for (int i = 0; i < np; i++) 
+      adaptivePiece(&P[3 * i], c, ts); 
   }
-
-  cerr << "\t>>> Steps (type steps): " << steps << endl;
-
-  vector<Vector3f> V, T, N, B; 
-  for (int i = 0; i + 3 < (int) P.size(); i += 3) {
-    vector<Vector3f> cp; 
-    for (int j = 0; j < 4; j++) 
-      cp.push_back(P[i + j]); 
-    for (int st = 0; st <= (int) steps; st++) {
-      float t = (0.f + st) / (0.f + steps); 
-      V.emplace_back(); 
-      T.emplace_back(); 
-      evalBezierAtT(cp, t, V.back(), T.back()); 
-      if (B.empty())
-        B.push_back(Vector3f(0.f, 0.f, 1.f)); 
-      N.push_back(Vector3f::cross(B.back(), T.back()).normalized()); 
-      if (!B.empty()) 
-        B.push_back(Vector3f::cross(T.back(), N.back()).normalized()); 
+  else {
+    int ns = steps + 1; 
+    c.resize(np * ns); 
+    if (evaluation == EVAL_FORWARD) {
+      for (int i = 0; i < np; i++) 
+        forwardPiece(&P[3 * i], steps, &c[i * ns]); 
+    }
+    else {
+      const BezierBasis &basis = bezierBasis(steps); 
+      for (int i = 0; i < np; i++) 
+        basisPiece(&P[3 * i], basis, steps, &c[i * ns]); 
     }
   }
+  computeFrames(c); 
+}
 
-  Curve c(V.size()); 
-  for (int i = 0; i < (int) V.size(); i++) {
-    c[i].V = V[i];
-    c[i].T = T[i];
-    c[i].N = N[i];
-    c[i].B = B[i];
-  }
-  rectifyNormal (c); 
+Curve evalBezier( const vector< Vector3f >& P, unsigned steps )
+{
+  Curve c; 
+  evalBezier(P, steps, c); 
   return c;
 }
 
-Curve evalBspline( const vector< Vector3f >& P, unsigned steps )
+void evalBspline( const vector< Vector3f >& P, unsigned steps, Curve &c )
 {
   // Check
   if( P.size() < 4 )
@@ -162,24 +306,89 @@ Curve evalBspline( const vector< Vector3f >& P, unsigned steps )
     exit( 0 );
   }
 
-  // It is suggested that you implement this function by changing
-  // basis from B-spline to Bezier.  That way, you can just call
-  // your evalBezier function.
+  // Change basis from B-spline to Bezier and evaluate that.
+  vector<Vector3f> bez; 
+  bsp2bez(P, bez); 
+  evalBezier(bez, steps, c); 
+}
 
-  cerr << "\t>>> evalBSpline has been called with the following input:" << endl;
+Curve evalBspline( const vector< Vector3f >& P, unsigned steps )
+{
+  Curve c; 
+  evalBspline(P, steps, c); 
+  return c;
+}
+
+ArcLengthTable::ArcLengthTable( const Curve& c )
+  : S(max<size_t>(c.size(), 1), 0.f)
+{
+  for (int i = 1; i < (int) c.size(); i++) 
+    S[i] = S[i - 1] + (c[i].V - c[i - 1].V).abs(); 
+}
+
+void ArcLengthTable::locate( float s, int& i, float& f ) const
+{
+  int n = S.size(); 
+  if (n < 2) {
+    i = 0; 
+    f = 0.f; 
+    return; 
+  }
+  i = upper_bound(S.begin(), S.end(), s) - S.begin() - 1; 
+  i = min(max(i, 0), n - 2); 
+  float len = S[i + 1] - S[i]; 
+  f = len > 0.f ? min(max((s - S[i]) / len, 0.f), 1.f) : 0.f; 
+}
 
-  cerr << "\t>>> Control points (type vector< Vector3f >): "<< endl;
-  for( unsigned i = 0; i < P.size(); ++i )
+Curve evalBezierUniform( const vector< Vector3f >& P, unsigned n )
+{
+  if( P.size() < 4 || P.size() % 3 != 1 )
   {
-    cerr << "\t>>> ";
-    P[i].print();
-    cerr << endl;
+    cerr << "evalBezierUniform must be called with 3n+1 control points." << endl;
+    exit( 0 );
+  }
+  int np = (P.size() - 1) / 3; 
+  n = max(n, 1u); 
+
+  // Measure the curve on a polyline at least eight times finer than
+  // the result, whose point i is at parameter i / d counted in
+  // pieces, so that locate turns an arc length into a parameter.
+  unsigned d = max(8u, (8 * n + np - 1) / np); 
+  const BezierBasis &basis = bezierBasis(d); 
+  Curve fine(np * d + 1); 
+  for (int i = 0; i < (int) fine.size(); i++) {
+    int p = min(i / (int) d, np - 1), k = i - p * d; 
+    evalWeights(&P[3 * p], &basis.w[4 * k], &basis.dw[4 * k], fine[i]); 
+  }
+  ArcLengthTable table(fine); 
+
+  // Each target is then evaluated on the curve itself, so the points
+  // and tangents are exact and only their spacing is approximate.
+  Curve c(n + 1); 
+  for (unsigned k = 0; k <= n; k++) {
+    int i; 
+    float f, w[4], dw[4]; 
+    table.locate(table.length() * k / n, i, f); 
+    float u = (i + f) / d; 
+    int p = min((int) u, np - 1); 
+    bezierWeights(u - p, w, dw); 
+    evalWeights(&P[3 * p], w, dw, c[k]); 
+  }
+  computeFrames(c); 
+  return c; 
+}
+
+Curve evalBsplineUniform( const vector< Vector3f >& P, unsigned n )
+{
+  if( P.size() < 4 )
+  {
+    cerr << "evalBsplineUniform must be called with 4 or more control points." << endl;
+    exit( 0 );
   }
 
-  cerr << "\t>>> Steps (type steps): " << steps << endl;
   vector<Vector3f> bez; 
   bsp2bez(P, bez); 
-  return evalBezier(bez, steps); 
+  return evalBezierUniform(bez, n); 
 }
 
 Curve evalCircle( float radius, unsigned steps )
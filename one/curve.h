@@ -38,10 +38,52 @@ Curve evalBezier( const std::vector< Vector3f >& P, unsigned steps );
 // Bsplines only require that there are at least 4 control points.
 Curve evalBspline( const std::vector< Vector3f >& P, unsigned steps );
 
+// The same, filling c in place so that its storage is reused when
+// curves are tessellated again.
+void evalBezier( const std::vector< Vector3f >& P, unsigned steps, Curve &c );
+void evalBspline( const std::vector< Vector3f >& P, unsigned steps, Curve &c );
+
+// How evalBezier samples each cubic piece: by weighing its control
+// points with precomputed basis values, or by forward differences,
+// which cost a few adds per sample. Both give the same curve to
+// within float rounding; the basis path is the default.
+enum CurveEvaluation { EVAL_BASIS, EVAL_FORWARD };
+void setCurveEvaluation( CurveEvaluation e );
+
+// With a tolerance above 0, evalBezier and evalBspline ignore steps
+// and split each piece until its polyline is within tol of the
+// curve, so straight runs get two samples and tight bends as many
+// as they need. 0, the default, goes back to steps per piece.
+void setCurveTolerance( float tol );
+
 // Create a circle on the xy-plane of radius and steps
 Curve evalCircle( float radius, unsigned steps);
 
 
+// Cumulative length of a curve's polyline, S[i] being the length
+// from the first point to point i, for finding the point at a given
+// arc length.
+struct ArcLengthTable
+{
+  ArcLengthTable( const Curve& c );
+
+  float length() const { return S.back(); }
+
+  // Finds, by binary search, the segment i (from point i to i+1)
+  // that holds arc length s and the fraction f of it that lies before s.
+  void locate( float s, int& i, float& f ) const;
+
+  std::vector< float > S;
+};
+
+// Samples the curve at n+1 points evenly spaced by arc length, from
+// its first point to its last, so that samples don't bunch up where
+// the parametric speed drops. The arc lengths are measured on a
+// dense polyline and located in its ArcLengthTable, and the curve is
+// evaluated again at the parameters found there.
+Curve evalBezierUniform( const std::vector< Vector3f >& P, unsigned n );
+Curve evalBsplineUniform( const std::vector< Vector3f >& P, unsigned n );
+
 // Draw the curve and (optionally) the associated coordinate frames
 // If framesize == 0, then no frames are drawn.  Otherwise, drawn.
 void drawCurve( const Curve& curve, float framesize = 0 );
@@ -0,0 +1,146 @@
+#include "mesh.h"
+#include "extra.h"
+#include "pool.h"
+
+using namespace std;
+
+namespace
+{
+  // Quartic box spline basis of a regular Loop patch (Stam, 
+  // "Evaluation of Loop Subdivision Surfaces", 1998), as 
+  // coefficients of the monomials u^a v^b w^c / 12 with w = 1-u-v,
+  // enumerated by MONOMIALS. 
+  const int MONOMIALS[15][3] = {
+    {0, 0, 4}, {0, 1, 3}, {0, 2, 2}, {0, 3, 1}, {0, 4, 0}, 
+    {1, 0, 3}, {1, 1, 2}, {1, 2, 1}, {1, 3, 0}, {2, 0, 2}, 
+    {2, 1, 1}, {2, 2, 0}, {3, 0, 1}, {3, 1, 0}, {4, 0, 0}
+  }; 
+
+  const float BOX_SPLINE[12][15] = {
+    {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  2,  1 },
+    {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  2,  0,  1 },
+    {  0,  0,  0,  2,  1,  0,  0,  6,  6,  0,  6, 12,  2,  6,  1 },
+    {  1,  6, 12,  6,  1,  8, 36, 36,  8, 24, 60, 24, 24, 24,  6 },
+    {  1,  2,  0,  0,  0,  6,  6,  0,  0, 12,  6,  0,  6,  2,  1 },
+    {  0,  0,  0,  0,  1,  0,  0,  0,  2,  0,  0,  0,  0,  0,  0 },
+    {  1,  8, 24, 24,  6,  6, 36, 60, 24, 12, 36, 24,  6,  8,  1 },
+    {  6, 24, 24,  8,  1, 24, 60, 36,  6, 24, 36, 12,  8,  6,  1 },
+    {  1,  0,  0,  0,  0,  2,  0,  0,  0,  0,  0,  0,  0,  0,  0 },
+    {  0,  0,  0,  2,  1,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },
+    {  1,  6, 12,  6,  1,  2,  6,  6,  2,  0,  0,  0,  0,  0,  0 },
+    {  1,  2,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 }
+  }; 
+
+  float ipow (float x, int n) {
+    float r = 1.f; 
+    while (n-- > 0) 
+      r *= x; 
+    return r; 
+  }
+
+  // Box spline weights and their u and v derivatives at (u, v).
+  void boxSpline (float u, float v, float b[12], float du[12], float dv[12]) {
+    float w = 1.f - u - v; 
+    float m[15], mu[15], mv[15]; 
+    for (int k = 0; k < 15; k++) {
+      int a = MONOMIALS[k][0], c = MONOMIALS[k][1], d = MONOMIALS[k][2]; 
+      float pu = ipow(u, a), pv = ipow(v, c), pw = ipow(w, d); 
+      // dw/du = dw/dv = -1
+      float dpu = a ? a * ipow(u, a - 1) : 0.f; 
+      float dpv = c ? c * ipow(v, c - 1) : 0.f; 
+      float dpw = d ? d * ipow(w, d - 1) : 0.f; 
+      m[k]  = pu * pv * pw; 
+      mu[k] = dpu * pv * pw - pu * pv * dpw; 
+      mv[k] = pu * dpv * pw - pu * pv * dpw; 
+    }
+    for (int i = 0; i < 12; i++) {
+      b[i] = du[i] = dv[i] = 0.f; 
+      for (int k = 0; k < 15; k++) {
+        b[i]  += BOX_SPLINE[i][k] * m[k]  / 12.f; 
+        du[i] += BOX_SPLINE[i][k] * mu[k] / 12.f; 
+        dv[i] += BOX_SPLINE[i][k] * mv[k] / 12.f; 
+      }
+    }
+  }
+}
+
+int Mesh::_ring (int v, int a, int b, int *ring, int maxValence) const {
+  // One-ring of v in cyclic order, starting a, b, ... 
+  int n = 0; 
+  halfEdges.forOneRing(v, [&] (int w) { 
+    if (n < maxValence) 
+      ring[n] = w; 
+    n++; 
+  }); 
+  if (n > maxValence) 
+    return n; 
+  int s = find(ring, ring + n, a) - ring; 
+  rotate(ring, ring + s, ring + n); 
+  if (n > 1 && ring[1] != b) 
+    reverse(ring + 1, ring + n); 
+  return n; 
+}
+
+void Mesh::limitProject () {
+  // Closed form limit masks for Loop subdivision: a vertex of 
+  // valence n lands on (1 - n X) p + X sum(q_i) where 
+  // X = 1 / (n + 3 / (8 BETA)), and the limit tangents are 
+  // sum(cos(2 pi i / n) q_i) and sum(sin(2 pi i / n) q_i) over
+  // the neighbours q_i taken in order around the vertex.
+  int nv = vertices.size(); 
+  VertexArrays limit; 
+  limit.resize(nv); 
+  parallelFor(nv, [&] (int begin, int end) {
+    vector<int> ring; 
+    for (int u = begin; u < end; u++) {
+      ring.clear(); 
+      halfEdges.forOneRing(u, [&] (int w) { ring.push_back(w); }); 
+      int n = ring.size(); 
+      float BETA = 3.f / ((n > 3) ? 8.f * n : 16.f);
+      float X = 1.f / (n + 3.f / (8.f * BETA)); 
+      Vector4f sum; 
+      Vector3f t1, t2; 
+      for (int i = 0; i < n; i++) {
+        Vector4f q = geom.position(ring[i]); 
+        sum = sum + q; 
+        t1 = t1 + cos(2.f * M_PI * i / n) * project(q); 
+        t2 = t2 + sin(2.f * M_PI * i / n) * project(q); 
+      }
+      Vector3f normal = Vector3f::cross(t1, t2).normalized(); 
+      // the ring may have been walked either way round.
+      if (Vector3f::dot(normal, project(geom.normal(u))) < 0) 
+        normal.negate(); 
+      limit.set(u, VertexGeometry((1.f - n * X) * geom.position(u) + X * sum, expand(normal))); 
+    }
+  }); 
+  geom.swap(limit); 
+}
+
+bool Mesh::evalLimit (int fi, float u, float v, Vector3f &P, Vector3f &N) const {
+  // A face whose corners all have valence 6 is a box spline patch
+  // over the 12 vertices of its one-ring. With the corners at 
+  // lattice points (0, 0), (1, 0) and (0, 1), the rings of the 
+  // corners fill in Stam's numbering of the control points.
+  const Face &f = faces[fi]; 
+  int r0[6], r1[6], r2[6]; 
+  if (_ring(f.vs[0], f.vs[1], f.vs[2], r0, 6) != 6 || 
+      _ring(f.vs[1], f.vs[2], f.vs[0], r1, 6) != 6 || 
+      _ring(f.vs[2], f.vs[0], f.vs[1], r2, 6) != 6) 
+    return false; 
+  int cp[12] = {
+    r1[4], r1[3], r1[5], f.vs[1], r0[5], r2[3], 
+    f.vs[2], f.vs[0], r0[4], r2[4], r0[2], r0[3]
+  }; 
+  float b[12], du[12], dv[12]; 
+  boxSpline(u, v, b, du, dv); 
+  Vector3f Pu, Pv; 
+  P = Vector3f(); 
+  for (int i = 0; i < 12; i++) {
+    Vector3f c = project(geom.position(cp[i])); 
+    P  = P  + b[i]  * c; 
+    Pu = Pu + du[i] * c; 
+    Pv = Pv + dv[i] * c; 
+  }
+  N = Vector3f::cross(Pu, Pv).normalized(); 
+  return true; 
+}
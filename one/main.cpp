@@ -5,8 +5,10 @@
 #include <cmath>
 #include <iostream>
 #include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <vector>
+#include <sys/stat.h>
 
 #include <GL/glut.h>
 #include <vecmath.h>
@@ -39,11 +41,12 @@ namespace
   // This detemines how big to draw the normals
   const float gLineLen = 0.1f;
 
-  // These are arrays for display lists for each drawing mode.  The
-  // convention is that drawmode 0 is "blank", and other drawmodes
-  // just call the appropriate display lists.
-  GLuint gCurveLists[3];
-  GLuint gSurfaceLists[3];
+  // Each curve and surface has a display list for drawing mode 1 and
+  // the list after it for mode 2 (drawing mode 0 is "blank"), 0
+  // until they are built. They are kept across reloads for the
+  // objects that don't change.
+  vector<GLuint> gCurveLists;
+  vector<GLuint> gSurfaceLists;
   GLuint gAxisList;
   GLuint gPointList;
 
@@ -57,6 +60,17 @@ namespace
   vector<Surface> gSurfaces;
   vector<string> gSurfaceNames;
 
+  // What gCurves and gSurfaces were evaluated from, so that reloads
+  // only evaluate what changed.
+  SwpReuse gReuse;
+
+  // The SWP file being shown, and its modification time and size
+  // when it was last read. It is polled so that edits show up
+  // without restarting.
+  string gSwpFile;
+  time_t gSwpTime = 0;
+  off_t gSwpSize = 0;
+
   // Declarations of functions whose implementations occur later.
   void arcballRotation(int endX, int endY);
   void keyboardFunc( unsigned char key, int x, int y);
@@ -67,7 +81,11 @@ namespace
   void drawScene(void);
   void initRendering();
   void loadObjects(int argc, char *argv[]);
+  bool updateObjects(istream &in);
   void makeDisplayLists();
+  void makeObjectLists();
+  void makePointList();
+  void watchFunc(int value);
 
   // This function is called whenever a "Normal" key press is
   // received.
@@ -192,10 +210,12 @@ namespace
 
     // Call the relevant display lists.
     if (gSurfaceMode)
-      glCallList(gSurfaceLists[gSurfaceMode]);
+      for (unsigned i=0; i<gSurfaceLists.size(); i++)
+        glCallList(gSurfaceLists[i] + gSurfaceMode - 1);
 
     if (gCurveMode)
-      glCallList(gCurveLists[gCurveMode]);
+      for (unsigned i=0; i<gCurveLists.size(); i++)
+        glCallList(gCurveLists[i] + gCurveMode - 1);
 
     // This draws the coordinate axes when you're rotating, to
     // keep yourself oriented.
@@ -256,9 +276,32 @@ namespace
   // loading fails, this will exit the program.
   void loadObjects(int argc, char *argv[])
   {
+    // "-t TOL" tessellates the curves to within TOL of the true
+    // curve instead of with the steps given in the file. "-u" sweeps
+    // generalized cylinders along evenly spaced points, and "-s"
+    // builds surfaces as triangle strips. "-b" writes binary PLY
+    // files instead of OBJ files.
+    bool binary = false;
+    vector<char *> args;
+    for (int i = 0; i < argc; i++)
+    {
+      if (!strcmp(argv[i], "-t") && i + 1 < argc)
+        setCurveTolerance(atof(argv[++i]));
+      else if (!strcmp(argv[i], "-u"))
+        setUniformSweep(true);
+      else if (!strcmp(argv[i], "-s"))
+        setStripSurfaces(true);
+      else if (!strcmp(argv[i], "-b"))
+        binary = true;
+      else
+        args.push_back(argv[i]);
+    }
+    argc = args.size();
+    argv = args.data();
+
     if (argc < 2)
     {
-      cerr<< "usage: " << argv[0] << " SWPFILE [OBJPREFIX] " << endl;
+      cerr<< "usage: " << argv[0] << " [-t TOL] [-u] [-s] [-b] SWPFILE [OBJPREFIX] " << endl;
       exit(0);
     }
 
@@ -269,12 +312,17 @@ namespace
       exit(0);
     }
 
+    gSwpFile = argv[1];
+    struct stat st;
+    if (stat(argv[1], &st) == 0)
+    {
+      gSwpTime = st.st_mtime;
+      gSwpSize = st.st_size;
+    }
 
     cerr << endl << "*** loading and constructing curves and surfaces ***" << endl;
 
-    if (!parseFile(in, gCtrlPoints,
-          gCurves, gCurveNames,
-          gSurfaces, gSurfaceNames))
+    if (!updateObjects(in))
     {
       cerr << "\aerror in file format\a" << endl;
       in.close();
@@ -297,9 +345,9 @@ namespace
           string filename =
             prefix + string("_")
             + gSurfaceNames[i]
-            + string(".obj");
+            + string(binary ? ".ply" : ".obj");
 
-          ofstream out(filename.c_str());
+          ofstream out(filename.c_str(), ios::binary);
 
           if (!out)
           {
@@ -309,7 +357,10 @@ namespace
           }
           else
           {
-            outputObjFile(out, gSurfaces[i]);
+            if (binary)
+              outputPlyFile(out, gSurfaces[i]);
+            else
+              outputObjFile(out, gSurfaces[i]);
             cerr << "wrote " << filename <<  endl;
           }
         }
@@ -322,47 +373,108 @@ namespace
 
   }
 
-  void makeDisplayLists()
+  // The display lists of the objects evalSwp carried over, moved to
+  // their new places (see SwpReuse). The lists of the objects that
+  // are gone are deleted and the new objects get 0.
+  vector<GLuint> carryLists(const vector<GLuint> &old, const vector<int> &sources)
   {
-    gCurveLists[1] = glGenLists(1);
-    gCurveLists[2] = glGenLists(1);
-    gSurfaceLists[1] = glGenLists(1);
-    gSurfaceLists[2] = glGenLists(1);
-    gAxisList = glGenLists(1);
-    gPointList = glGenLists(1);
+    vector<GLuint> lists(sources.size(), 0);
+    vector<bool> kept(old.size(), false);
+    for (unsigned i=0; i<sources.size(); i++)
+      if (sources[i] >= 0)
+      {
+        lists[i] = old[sources[i]];
+        kept[sources[i]] = true;
+      }
+    for (unsigned i=0; i<old.size(); i++)
+      if (!kept[i] && old[i])
+        glDeleteLists(old[i], 2);
+    return lists;
+  }
 
-    // Compile the display lists
+  // Reads the objects of a SWP file from in and evaluates only the
+  // curves whose definitions changed since the last read, and the
+  // surfaces whose definitions or curves changed. Everything else is
+  // carried over. If the file doesn't parse, returns false and
+  // leaves the scene as it was.
+  bool updateObjects(istream &in)
+  {
+    vector<SwpObject> objects;
+    if (!readSwp(in, objects))
+      return false;
+    evalSwp(objects, gCtrlPoints, gCurves, gCurveNames,
+        gSurfaces, gSurfaceNames, &gReuse);
+    gCurveLists = carryLists(gCurveLists, gReuse.curveSources);
+    gSurfaceLists = carryLists(gSurfaceLists, gReuse.surfaceSources);
+    return true;
+  }
 
-    glNewList(gCurveLists[1], GL_COMPILE);
+  // Polls the SWP file twice a second and reloads it when its
+  // modification time or size changes. A file that doesn't parse,
+  // eg. one caught halfway through being saved, is reported and the
+  // last good version stays on screen.
+  void watchFunc(int value)
+  {
+    struct stat st;
+    if (stat(gSwpFile.c_str(), &st) == 0 &&
+        (st.st_mtime != gSwpTime || st.st_size != gSwpSize))
     {
-      for (unsigned i=0; i<gCurves.size(); i++)
-        drawCurve(gCurves[i], 0.0);
+      gSwpTime = st.st_mtime;
+      gSwpSize = st.st_size;
+      cerr << endl << "*** " << gSwpFile << " changed, reloading ***" << endl;
+      ifstream in(gSwpFile.c_str());
+      if (updateObjects(in))
+      {
+        makeObjectLists();
+        makePointList();
+        glutPostRedisplay();
+      }
+      else
+        cerr << "\aerror in file format, keeping the last version\a" << endl;
     }
-    glEndList();
+    glutTimerFunc(500, watchFunc, 0);
+  }
 
-    glNewList(gCurveLists[2], GL_COMPILE);
+  // Builds the display lists of the curves and surfaces that don't
+  // have them yet.
+  void makeObjectLists()
+  {
+    for (unsigned i=0; i<gCurves.size(); i++)
     {
-      for (unsigned i=0; i<gCurves.size(); i++)
-        drawCurve(gCurves[i], gLineLen);
+      if (gCurveLists[i])
+        continue;
+      gCurveLists[i] = glGenLists(2);
+      glNewList(gCurveLists[i], GL_COMPILE);
+      drawCurve(gCurves[i], 0.0);
+      glEndList();
+      glNewList(gCurveLists[i] + 1, GL_COMPILE);
+      drawCurve(gCurves[i], gLineLen);
+      glEndList();
     }
-    glEndList();
 
-    glNewList(gSurfaceLists[1], GL_COMPILE);
+    for (unsigned i=0; i<gSurfaces.size(); i++)
     {
-      for (unsigned i=0; i<gSurfaces.size(); i++)
-        drawSurface(gSurfaces[i], true);
+      if (gSurfaceLists[i])
+        continue;
+      gSurfaceLists[i] = glGenLists(2);
+      glNewList(gSurfaceLists[i], GL_COMPILE);
+      drawSurface(gSurfaces[i], true);
+      glEndList();
+      glNewList(gSurfaceLists[i] + 1, GL_COMPILE);
+      drawSurface(gSurfaces[i], false);
+      drawNormals(gSurfaces[i], gLineLen);
+      glEndList();
     }
-    glEndList();
+  }
 
-    glNewList(gSurfaceLists[2], GL_COMPILE);
-    {
-      for (unsigned i=0; i<gSurfaces.size(); i++)
-      {
-        drawSurface(gSurfaces[i], false);
-        drawNormals(gSurfaces[i], gLineLen);
-      }
-    }
-    glEndList();
+  void makeDisplayLists()
+  {
+    gAxisList = glGenLists(1);
+    gPointList = glGenLists(1);
+
+    // Compile the display lists
+
+    makeObjectLists();
 
     glNewList(gAxisList, GL_COMPILE);
     {
@@ -391,6 +503,13 @@ namespace
     }
     glEndList();
 
+    makePointList();
+  }
+
+  // The control points change with any edit, and are cheap to draw,
+  // so their list is simply compiled again.
+  void makePointList()
+  {
     glNewList(gPointList, GL_COMPILE);
     {
       // Save current state of OpenGL
@@ -466,6 +585,9 @@ int main( int argc, char* argv[] )
   // Trigger timerFunc every 20 msec
   //  glutTimerFunc(20, timerFunc, 0);
 
+  // Reload the SWP file when it changes
+  glutTimerFunc(500, watchFunc, 0);
+
   makeDisplayLists();
 
   // Start the main loop.  glutMainLoop never returns.
@@ -1,12 +1,58 @@
 #include "mesh.h"
 #include "extra.h"
+#include "pool.h"
 #include <sstream>
-#include <map> 
+#include <cmath>
+#include <cstdint>
+#include <atomic>
 
 using namespace std;
 
 const int MAX_BUFFER_SIZE = 200;
 
+namespace
+{
+  const int RADIX_BITS = 11; 
+
+  // Stable LSD radix sort of keys, carrying vals along, on their 
+  // low `bits` bits. Every pass counts digits over fixed blocks in
+  // parallel, turns the counts into offsets digit by digit and block
+  // by block, and lets each block scatter into its own slots.
+  void radixSort (vector<uint64_t> &keys, vector<int> &vals, int bits) {
+    int n = keys.size(), B = 1 << RADIX_BITS; 
+    int nb = max(1, min(4 * ThreadPool::instance().size(), n / 4096)); 
+    int per = (n + nb - 1) / nb; 
+    vector<uint64_t> keys2(n); 
+    vector<int> vals2(n), offset((size_t) nb * B); 
+    for (int shift = 0; shift < bits; shift += RADIX_BITS) {
+      fill(offset.begin(), offset.end(), 0); 
+      parallelFor(nb, [&] (int b0, int b1) {
+        for (int b = b0; b < b1; b++) 
+          for (int i = b * per; i < min(n, (b + 1) * per); i++) 
+            offset[b * B + ((keys[i] >> shift) & (B - 1))]++; 
+      }, 1); 
+      int sum = 0; 
+      for (int d = 0; d < B; d++) 
+        for (int b = 0; b < nb; b++) {
+          int c = offset[b * B + d]; 
+          offset[b * B + d] = sum; 
+          sum += c; 
+        }
+      parallelFor(nb, [&] (int b0, int b1) {
+        for (int b = b0; b < b1; b++) 
+          for (int i = b * per; i < min(n, (b + 1) * per); i++) {
+            int &o = offset[b * B + ((keys[i] >> shift) & (B - 1))]; 
+            keys2[o] = keys[i]; 
+            vals2[o] = vals[i]; 
+            o++; 
+          }
+      }, 1); 
+      keys.swap(keys2); 
+      vals.swap(vals2); 
+    }
+  }
+}
+
 VertexGeometry::VertexGeometry() {}
 
 VertexGeometry::VertexGeometry (Vector4f v, Vector4f vn) : v(v), vn(vn) {
@@ -23,22 +69,43 @@ VertexGeometry linearCombination (const vector<VertexGeometry> &geoms, vector<fl
   return g; 
 }
 
-Vertex::Vertex (int id, VertexGeometry geom) : id(id), geom(geom) {} 
+void VertexArrays::resize (int n) {
+  for (auto *a : { &x, &y, &z, &nx, &ny, &nz }) 
+    a->resize(n); 
+}
 
-Vertex::Vertex (int id, VertexGeometry geom, SI &fs) : id(id), geom(geom), fs(fs) {}; 
+void VertexArrays::swap (VertexArrays &o) {
+  x.swap(o.x); y.swap(o.y); z.swap(o.z); 
+  nx.swap(o.nx); ny.swap(o.ny); nz.swap(o.nz); 
+}
 
-Vertex::Vertex (int id, VertexGeometry geom, SI &fs, SI &es) : id(id), geom(geom), fs(fs), es(es) {}; 
+void VertexArrays::set (int v, const VertexGeometry &g) {
+  x[v]  = g.v.x();  y[v]  = g.v.y();  z[v]  = g.v.z(); 
+  nx[v] = g.vn.x(); ny[v] = g.vn.y(); nz[v] = g.vn.z(); 
+}
 
-bool Vertex::hasFace (int f) { return fs.count(f) > 0; }
+void VertexArrays::normalize (int begin, int end) {
+  // plain loop over contiguous floats so that it vectorizes
+  for (int v = begin; v < end; v++) {
+    float l = 1.f / sqrt(nx[v] * nx[v] + ny[v] * ny[v] + nz[v] * nz[v]); 
+    nx[v] *= l; 
+    ny[v] *= l; 
+    nz[v] *= l; 
+  }
+}
 
-bool Vertex::hasEdge (int e) { return es.count(e) > 0; } 
+Vertex::Vertex (int id) : id(id) {} 
+
+Vertex::Vertex (int id, VI &fs) : id(id), fs(fs) {}; 
+
+Vertex::Vertex (int id, VI &fs, VI &es) : id(id), fs(fs), es(es) {}; 
+
+bool Vertex::hasFace (int f) const { return find(fs.begin(), fs.end(), f) != fs.end(); }
+
+bool Vertex::hasEdge (int e) const { return find(es.begin(), es.end(), e) != es.end(); } 
 
 void Vertex::print() {
   cout << "vertex id : " << id << endl;
-  cout << "geometry : ";
-  geom.v.print();
-  geom.vn.print(); 
-  cout << endl;
   cout << "faces : " << endl;
   for (int i : fs) 
     cout << i << " ";
@@ -58,14 +125,14 @@ Face::Face (int id, Ini vvs, Ini ees) : id(id) {
   copy_n(ees.begin(), 3, es); 
 }
 
-bool Face::hasVert (int v) {
+bool Face::hasVert (int v) const {
   for (int i = 0; i < 3; i++)
     if (vs[i] == v) 
       return true;
   return false;
 }
 
-bool Face::hasEdge (int e) {
+bool Face::hasEdge (int e) const {
   for (int i = 0; i < 3; i++) 
     if (es[i] == e) 
       return true;
@@ -93,15 +160,15 @@ Edge::Edge (int id, Ini vvs, Ini ffs) : id(id) {
   copy_n(ffs.begin(), 2, fs); 
 }
 
-int Edge::v(int u) { 
+int Edge::v(int u) const { 
   return ((u == vs[0]) ? vs[1] : vs[0]);
 }
 
-bool Edge::hasVert(int u) { 
+bool Edge::hasVert(int u) const { 
   return (u == vs[0] || u == vs[1]); 
 }
 
-bool Edge::hasFace (int f) {
+bool Edge::hasFace (int f) const {
   return (f == fs[0] || f == fs[1]); 
 }
 
@@ -123,6 +190,30 @@ void Edge::print() {
   cout << endl;
 }
 
+void HalfEdgeMesh::build (const vector<Face> &faces, const vector<Edge> &edges, int nv) {
+  int nh = 3 * faces.size(); 
+  origin.resize(nh); 
+  edge.resize(nh); 
+  twin.assign(nh, -1); 
+  vertexHalf.assign(nv, -1); 
+  edgeHalf.assign(edges.size(), -1); 
+  for (int f = 0; f < (int) faces.size(); f++) 
+    for (int i = 0; i < 3; i++) {
+      int h = 3 * f + i; 
+      origin[h] = faces[f].vs[i]; 
+      edge[h] = faces[f].es[i]; 
+      vertexHalf[origin[h]] = h; 
+      // the second half-edge seen on an edge is the first one's twin
+      int &g = edgeHalf[edge[h]]; 
+      if (g < 0) {
+        g = h; 
+      } else {
+        twin[g] = h; 
+        twin[h] = g; 
+      }
+    }
+}
+
 void Mesh::draw () {
   // Save current state of OpenGL
   glPushAttrib(GL_ALL_ATTRIB_BITS);
@@ -140,8 +231,8 @@ void Mesh::draw () {
   glBegin(GL_TRIANGLES);
   for (auto &f: faces) {
     for (int i = 0; i < 3; i++) {
-      glNormal(vertices[f.vs[i]].geom.vn); 
-      glVertex(vertices[f.vs[i]].geom.v); 
+      glNormal3f(geom.nx[f.vs[i]], geom.ny[f.vs[i]], geom.nz[f.vs[i]]); 
+      glVertex3f(geom.x[f.vs[i]], geom.y[f.vs[i]], geom.z[f.vs[i]]); 
     }
   }
   glEnd();
@@ -211,240 +302,372 @@ bool Mesh::read (ifstream &in) {
     vert2norm[d] = f;
     vert2norm[g] = i;
   }
-  for (int i = 0; i < (int) vecv.size(); i++)
-    vertices.emplace_back(i, VertexGeometry(vecv[i], vecn[vert2norm[i]])); 
+  geom.resize(vecv.size()); 
+  for (int i = 0; i < (int) vecv.size(); i++) {
+    vertices.emplace_back(i); 
+    geom.set(i, VertexGeometry(vecv[i], vecn[vert2norm[i]])); 
+  }
   // take closure to make mesh consistent
-  closure();
-  if (!consistent()) {
+  if (!closure()) {
     cerr << "* read obj incorrectly!! *" << endl;
     return false;
   }
+  orient(); 
   return true;
 }
 
-void Mesh::_orient (Face &a, Face &b) {
-  // orient the face `a` with face `b`
-  Vector3f n1, n2; 
-  {
-    Vector3f x = project(vertices[a.vs[0]].geom.v).normalized();
-    Vector3f y = project(vertices[a.vs[1]].geom.v).normalized();
-    Vector3f z = project(vertices[a.vs[2]].geom.v).normalized();
-    n1 = Vector3f::cross(x - y, x - z); 
-  }
-  {
-    Vector3f x = project(vertices[b.vs[0]].geom.v).normalized();
-    Vector3f y = project(vertices[b.vs[1]].geom.v).normalized();
-    Vector3f z = project(vertices[b.vs[2]].geom.v).normalized();
-    n2 = Vector3f::cross(x - y, x - z); 
-  }
-  if (Vector3f::dot(n1, n2) < 0) 
-    swap(a.vs[0], a.vs[1]); 
-}
-
-bool Mesh::consistent () {
-  // check for consistency in ids.
-  for (int i = 0; i < (int) vertices.size(); i++) 
-    if (i != vertices[i].id) {
-      cerr << "* vertex id mismatch - " << i << " " << vertices[i].id << " *" << endl;
-      return false;
-    }
-
-  for (int i = 0; i < (int) faces.size(); i++) 
-    if (i != faces[i].id) {
-      cerr << "* face id mismatch - " << i << " " << faces[i].id << " *" << endl;
-      return false;
+void Mesh::orient () {
+  // Walk each connected piece breadth first from one face, flipping
+  // neighbours so that they run along every shared edge the other 
+  // way, then flip the whole piece if it encloses negative volume.
+  // Subdivision keeps the winding from here on.
+  int nf = faces.size(); 
+  vector<int> piece(nf, -1), queue; 
+  auto flip = [&] (Face &f) {
+    // keep es[i] running from vs[i] to vs[i + 1]
+    swap(f.vs[0], f.vs[1]); 
+    swap(f.es[1], f.es[2]); 
+  }; 
+  for (int root = 0; root < nf; root++) {
+    if (piece[root] >= 0) 
+      continue; 
+    queue.assign(1, root); 
+    piece[root] = root; 
+    for (int q = 0; q < (int) queue.size(); q++) {
+      Face &f = faces[queue[q]]; 
+      for (int k = 0; k < 3; k++) {
+        const Edge &e = edges[f.es[k]]; 
+        int gi = e.fs[0] == f.id ? e.fs[1] : e.fs[0]; 
+        if (piece[gi] >= 0) 
+          continue; 
+        Face &g = faces[gi]; 
+        int kg = find(g.es, g.es + 3, e.id) - g.es; 
+        if (g.vs[kg] == f.vs[k]) 
+          flip(g); 
+        piece[gi] = root; 
+        queue.push_back(gi); 
+      }
     }
-
-  for (int i = 0; i < (int) edges.size(); i++) 
-    if (i != edges[i].id) {
-      cerr << "* edges id mismatch - " << i << " " << edges[i].id << " *" << endl;
-      return false;
+    float volume = 0; 
+    for (int fi : queue) {
+      Vector3f a = project(geom.position(faces[fi].vs[0])); 
+      Vector3f b = project(geom.position(faces[fi].vs[1])); 
+      Vector3f c = project(geom.position(faces[fi].vs[2])); 
+      volume += Vector3f::dot(a, Vector3f::cross(b, c)); 
     }
-
-  // check whether each simplex contains ids of adjacent elements.
-  for (int i = 0; i < (int) vertices.size(); i++) {
-    for (auto j : vertices[i].es) 
-      if (!edges[j].hasVert(i)) {
-        cerr << "* vertex edge mismatch *" << endl;
-        return false;
-      }
-    for (auto j : vertices[i].fs) 
-      if (!faces[j].hasVert(i)) {
-        cerr << "* vertex face mismatch *" << endl;
-        return false;
-      }
+    if (volume < 0) 
+      for (int fi : queue) 
+        flip(faces[fi]); 
   }
+  halfEdges.build(faces, edges, vertices.size()); 
+}
 
-  for (int i = 0; i < (int) faces.size(); i++) {
-    for (int j = 0; j < 3; j++) 
-      if (!edges[faces[i].es[j]].hasFace(i)) {
-        cerr << "* face edge mismatch *" << endl;
-        return false;
-      }
-    for (int j = 0; j < 3; j++) 
-      if (!vertices[faces[i].vs[j]].hasFace(i)) {
-        cerr << "* face vertex mismatch *" << endl;
-        return false;
-      }
+bool Mesh::validate (Validation level) const {
+  if (level == VALIDATE_OFF) 
+    return true; 
+  int nv = vertices.size(), nf = faces.size(), ne = edges.size(); 
+
+  // Each check runs over the pool and stops early once anything 
+  // has failed; the first failure is the one reported.
+  atomic<bool> failed(false); 
+  const char *what = 0; 
+  int where = -1; 
+  auto each = [&] (int n, const char *msg, auto ok) {
+    parallelFor(n, [&] (int begin, int end) {
+      for (int i = begin; i < end && !failed; i++) 
+        if (!ok(i) && !failed.exchange(true)) {
+          what = msg; 
+          where = i; 
+        }
+    }); 
+  }; 
+  auto in = [] (int i, int n) { return i >= 0 && i < n; }; 
+
+  if (2 * ne != 3 * nf || geom.size() != nv) {
+    cerr << "* element counts don't add up - " << nv << " " << ne << " " << nf << " *" << endl;
+    return false; 
   }
-
-  for (int i = 0; i < (int) edges.size(); i++) {
-    for (int j = 0; j < 2; j++) 
-      if (!faces[edges[i].fs[j]].hasEdge(i)) {
-        cerr << "* edge face mismatch *" << endl;
-        return false;
-      }
-    for (int j = 0; j < 2; j++) 
-      if (!vertices[edges[i].vs[j]].hasEdge(i)) {
-        cerr << "* edge vertex mismatch *" << endl;
-        return false;
-      }
+  each(nv, "vertex id mismatch", [&] (int i) { return vertices[i].id == i; }); 
+  each(nf, "bad face", [&] (int i) {
+    const Face &f = faces[i]; 
+    if (f.id != i) 
+      return false; 
+    for (int k = 0; k < 3; k++) {
+      int a = f.vs[k], b = f.vs[(k + 1) % 3], e = f.es[k]; 
+      if (!in(a, nv) || a == b || !in(e, ne)) 
+        return false; 
+      // edge k runs between corners k and k + 1
+      if (!edges[e].hasVert(a) || !edges[e].hasVert(b) || !edges[e].hasFace(i)) 
+        return false; 
+    }
+    return true; 
+  }); 
+  each(ne, "bad edge", [&] (int i) {
+    const Edge &e = edges[i]; 
+    return e.id == i && in(e.vs[0], nv) && in(e.vs[1], nv) && e.vs[0] != e.vs[1] && 
+      in(e.fs[0], nf) && in(e.fs[1], nf) && e.fs[0] != e.fs[1] && 
+      faces[e.fs[0]].hasEdge(i) && faces[e.fs[1]].hasEdge(i); 
+  }); 
+
+  if (level == VALIDATE_FULL && !failed) {
+    // every simplex contains the ids of the adjacent ones
+    each(nv, "vertex adjacency mismatch", [&] (int i) {
+      const Vertex &v = vertices[i]; 
+      if (v.fs.size() != v.es.size()) 
+        return false; 
+      for (int j : v.fs) 
+        if (!in(j, nf) || !faces[j].hasVert(i)) 
+          return false; 
+      for (int j : v.es) 
+        if (!in(j, ne) || !edges[j].hasVert(i)) 
+          return false; 
+      return true; 
+    }); 
+    each(nf, "face vertex mismatch", [&] (int i) {
+      for (int v : faces[i].vs) 
+        if (!vertices[v].hasFace(i)) 
+          return false; 
+      return true; 
+    }); 
+    each(ne, "edge vertex mismatch", [&] (int i) {
+      return vertices[edges[i].vs[0]].hasEdge(i) && vertices[edges[i].vs[1]].hasEdge(i); 
+    }); 
   }
 
-  return true;
-
+  if (failed) 
+    cerr << "* " << what << " - " << where << " *" << endl;
+  return !failed; 
 }
 
-void Mesh::closure () {
+bool Mesh::closure () {
   // Assume at this point that the vertices are ordered 
   // with the correct ids and the faces have the correct
   // vertex ids. All other information is dubious. 
 
-  // Remove potentially false edge/face information in vertices.
-  for (auto &v : vertices) {
-    v.es.clear();
-    v.fs.clear(); 
-  }
+  int nf = faces.size(), nh = 3 * nf; 
+
+  // Side j of face f gets a key made of the ids of its two ends, 
+  // smaller first, packed in as few bits as the vertex count needs.
+  // Sorting the keys brings the two sides of every edge together 
+  // and the edges get their ids run by run in key order, which is
+  // the order of (smaller id, larger id). 
+  int vb = 1; 
+  while ((1 << vb) < (int) vertices.size()) 
+    vb++; 
+  vector<uint64_t> keys(nh); 
+  vector<int> sides(nh); 
+  parallelFor(nf, [&] (int begin, int end) {
+    for (int f = begin; f < end; f++) 
+      for (int j = 0; j < 3; j++) {
+        uint64_t a = faces[f].vs[j], b = faces[f].vs[(j + 1) % 3]; 
+        keys[3 * f + j] = (min(a, b) << vb) | max(a, b); 
+        sides[3 * f + j] = 3 * f + j; 
+      }
+  }); 
+  radixSort(keys, sides, 2 * vb); 
 
-  // Find the edges and record correspondence with faces. 
-  map<Edge, vector<int> > edge2face; 
-  for (int i = 0; i < (int) faces.size(); i++) {
-    auto &f = faces[i]; 
-    for (int j = 0; j < 3; j++) {
-      int a = f.vs[j], b = f.vs[(1 + j) % 3];
-      // init edge with dummy id for now. 
-      edge2face[Edge(-1, {a, b})].push_back(i); 
-    }
-  }
+  // The sort is stable, so the first side of a run belongs to the
+  // lowest numbered face and gives the edge its direction.
   edges.clear(); 
-  int eid = 0;
-  for (auto p : edge2face) {
-    edges.push_back(p.first); 
-    // set correct id. 
-    edges.back().id = eid++;
-    for (int j = 0; j < 2; j++) 
-      edges.back().fs[j] = p.second[j]; 
+  for (int i = 0; i < nh; ) {
+    int j = i + 1; 
+    while (j < nh && keys[j] == keys[i]) 
+      j++; 
+    if (j - i != 2) {
+      cerr << "* edge with " << j - i << " faces, mesh isn't closed and manifold *" << endl;
+      return false; 
+    }
+    int f = sides[i] / 3, k = sides[i] % 3, g = sides[i + 1] / 3; 
+    int id = edges.size(); 
+    edges.push_back(Edge(id, { faces[f].vs[k], faces[f].vs[(k + 1) % 3] }, { f, g })); 
+    // edge k of a face runs from its k'th corner to the next one
+    faces[f].es[k] = id; 
+    faces[g].es[sides[i + 1] % 3] = id; 
+    i = j; 
   }
 
-  // At this point only edges have complete information.
-  // Propagate edge and face ids to the vertices. 
-  for (auto &f : faces)
-    for (int i = 0; i < 3; i++) 
-      vertices[f.vs[i]].fs.insert(f.id); 
-
-  for (auto &e : edges)
-    for (int i = 0; i < 2; i++) 
-      vertices[e.vs[i]].es.insert(e.id); 
-
-  // Now the faces need to know about the edges. 
-  map<int, vector<int> > face2edge; 
-  for (int i = 0; i < (int) edges.size(); i++) 
-    for (int j = 0; j < 2; j++) 
-      face2edge[edges[i].fs[j]].push_back(i); 
-  for (int i = 0; i < (int) faces.size(); i++) 
-    for (int j = 0; j < 3; j++) 
-      faces[i].es[j] = face2edge[i][j];
-
-  // At this point, mesh must be consistent. If not
-  // raise an error and exit. 
-  if (!consistent()) {
+  halfEdges.build(faces, edges, vertices.size()); 
+  _adjacency(); 
+
+  // At this point, mesh must be consistent. 
+  if (!validate(validation)) {
     cerr << "* Mesh isn't consistent!! *" << endl;
-    exit(0); 
+    return false; 
   }
+  return true; 
 }
 
-void Mesh::loopSubdivide () {
+void Mesh::_adjacency () {
+  // Walk the faces around each vertex; every step crosses one edge
+  // into the next face.
+  const HalfEdgeMesh &he = halfEdges; 
+  parallelFor(vertices.size(), [&] (int begin, int end) {
+    for (int v = begin; v < end; v++) {
+      Vertex &V = vertices[v]; 
+      V.fs.clear(); 
+      V.es.clear(); 
+      V.fs.reserve(6); 
+      V.es.reserve(6); 
+      int start = he.vertexHalf[v], h = start; 
+      if (start < 0) 
+        continue; 
+      do {
+        bool out = (he.origin[h] == v); 
+        V.fs.push_back(h / 3); 
+        V.es.push_back(he.edge[h]); 
+        h = he.twin[out ? he.prev(h) : he.next(h)]; 
+      } while (h != start && h >= 0); 
+    }
+  }); 
+}
 
-  int nv = vertices.size(), ne = edges.size(); 
-  vector<VertexGeometry> even, odd;
+void Mesh::_evenGeometry (int u, VertexArrays &out, int i) const {
+  // Loop mask of an even vertex. Each component is summed from its
+  // own array.
+  float s[6] = { 0, 0, 0, 0, 0, 0 }; 
+  int valence = halfEdges.forOneRing(u, [&] (int w) {
+    s[0] += geom.x[w];  s[1] += geom.y[w];  s[2] += geom.z[w]; 
+    s[3] += geom.nx[w]; s[4] += geom.ny[w]; s[5] += geom.nz[w]; 
+  }); 
+  float BETA = 3.f / ((valence > 3) ? 8.f * valence : 16.f);
+  float self = 1.f - (BETA * valence); 
+  out.x[i]  = BETA * s[0] + self * geom.x[u]; 
+  out.y[i]  = BETA * s[1] + self * geom.y[u]; 
+  out.z[i]  = BETA * s[2] + self * geom.z[u]; 
+  out.nx[i] = BETA * s[3] + self * geom.nx[u]; 
+  out.ny[i] = BETA * s[4] + self * geom.ny[u]; 
+  out.nz[i] = BETA * s[5] + self * geom.nz[u]; 
+}
 
-  // compute new positions for even vertices
-  for (auto &u: vertices) {
-    vector<VertexGeometry> geoms; 
-    for (auto ei : u.es) {
-      int v = edges[ei].v(u.id); 
-      geoms.push_back(vertices[v].geom); 
-    }
-    int valence = geoms.size(); 
-    float BETA = 3.f / ((valence > 3) ? 8.f * valence : 16.f);
-    vector<float> cs(valence, BETA); 
-    geoms.push_back(u.geom); 
-    cs.push_back(1.f - (BETA * valence)); 
-    even.push_back(linearCombination(geoms, cs)); 
-  }
+void Mesh::_oddGeometry (int e, VertexArrays &out, int i) const {
+  // Loop mask of the odd vertex on edge e.
+  const HalfEdgeMesh &he = halfEdges; 
+  int h = he.edgeHalf[e], t = he.twin[h]; 
+  int a = he.origin[h], b = he.dest(h), c = he.opposite(h), d = he.opposite(t); 
+  auto mask = [&] (const vector<float> &p) {
+    return (3.f / 8.f) * (p[a] + p[b]) + (1.f / 8.f) * (p[c] + p[d]); 
+  }; 
+  out.x[i]  = mask(geom.x);  out.y[i]  = mask(geom.y);  out.z[i]  = mask(geom.z); 
+  out.nx[i] = mask(geom.nx); out.ny[i] = mask(geom.ny); out.nz[i] = mask(geom.nz); 
+}
 
-  // compute new positions for even vertices
-  for (auto &e: edges) { 
-    vector<VertexGeometry> geoms;
-    for (int i = 0; i < 2; i++) 
-      for (int j = 0; j < 3; j++) {
-        int fv = faces[e.fs[i]].vs[j];
-        if (!e.hasVert(fv))
-          geoms.push_back(vertices[fv].geom);
-      }
-    geoms.push_back(vertices[e.vs[0]].geom);
-    geoms.push_back(vertices[e.vs[1]].geom);
-    vector<float> cs = { 1.f / 8.f, 1.f / 8.f, 3.f / 8.f, 3.f / 8.f };
-    odd.push_back(linearCombination(geoms, cs));  
-  }
+void Mesh::loopSubdivide () {
+
+  int nv = vertices.size(), ne = edges.size(), nf = faces.size(); 
+
+  // Every pass below handles each element independently, so they
+  // are all split over the thread pool.
+
+  // new positions for the even vertices, then the odd ones
+  VertexArrays refined; 
+  refined.resize(nv + ne); 
+  parallelFor(nv, [&] (int begin, int end) {
+    for (int u = begin; u < end; u++) 
+      _evenGeometry(u, refined, u); 
+  }); 
+  parallelFor(ne, [&] (int begin, int end) {
+    for (int e = begin; e < end; e++) 
+      _oddGeometry(e, refined, nv + e); 
+  }); 
+  parallelFor(nv + ne, [&] (int begin, int end) {
+    refined.normalize(begin, end); 
+  }); 
   
-  // push the new vertices 
-  for (auto &e: edges) 
-    vertices.push_back(
-      Vertex(
-        nv + e.id, 
-        linearCombination(
-          vector<VertexGeometry>({ 
-            vertices[e.vs[0]].geom,
-            vertices[e.vs[1]].geom
-          }),
-          vector<float>({ 0.5f, 0.5f })
-        )
-      )
-    );
-
-  // compute new faces 
-  vector<Face> newFaces; 
-  for (auto &f : faces) {
-    // the faces containing one `even` vertex
-    // and 2 `odd` vertices. 
-    for (int i = 0; i < 3; i++) {
-      int vi = f.vs[i]; 
-      int ev[2], id = 0;
-      for (int j = 0; j < 3; j++) 
-        if (edges[f.es[j]].hasVert(vi))
-          ev[id++] = nv + f.es[j];
-      newFaces.push_back(Face(
-        newFaces.size(), 
-        { vi, ev[0], ev[1] }
-      )); 
-      _orient(newFaces.back(), f); 
+  // The refined connectivity is written straight into arrays of
+  // their final size: V' = V + E, E' = 2E + 3F and F' = 4F. Even
+  // vertex v keeps its id and the odd vertex on edge e is V + e.
+  // Edge e splits into 2e (at e.vs[0]) and 2e + 1 (at e.vs[1]) and
+  // the edge cutting off corner i of face f is 2E + 3f + i. Corner
+  // i of face f becomes face 4f + i and the middle one 4f + 3.
+  auto half = [&] (int e, int v) { return 2 * e + (edges[e].vs[0] == v ? 0 : 1); }; 
+  auto inner = [&] (int f, int i) { return 2 * ne + 3 * f + i; }; 
+  auto corner = [&] (int f, int v) { 
+    const int *vs = faces[f].vs; 
+    return 4 * f + (int) (find(vs, vs + 3, v) - vs); 
+  }; 
+
+  vector<Vertex> newVertices(nv + ne, Vertex(-1)); 
+  parallelFor(nv, [&] (int begin, int end) {
+    for (int u = begin; u < end; u++) {
+      Vertex &nu = newVertices[u]; 
+      nu.id = u; 
+      nu.fs.reserve(vertices[u].fs.size()); 
+      nu.es.reserve(vertices[u].es.size()); 
+      for (int e : vertices[u].es) 
+        nu.es.push_back(half(e, u)); 
+      for (int fi : vertices[u].fs) 
+        nu.fs.push_back(corner(fi, u)); 
     }
-    // the face containing 3 `odd` vertices
-    newFaces.push_back(Face(
-      newFaces.size(), 
-      { nv + f.es[0], nv + f.es[1], nv + f.es[2] }
-    )); 
-    _orient(newFaces.back(), f); 
-  }
-  faces = newFaces; 
-
-  // update connectivity information
-  closure(); 
+  }); 
+  parallelFor(ne, [&] (int begin, int end) {
+    for (int e = begin; e < end; e++) {
+      Vertex &ne_ = newVertices[nv + e]; 
+      ne_.id = nv + e; 
+      ne_.es = { 2 * e, 2 * e + 1 }; 
+      ne_.fs.reserve(6); 
+      ne_.es.reserve(6); 
+      for (int k = 0; k < 2; k++) {
+        auto &f = faces[edges[e].fs[k]]; 
+        int i = find(f.es, f.es + 3, e) - f.es, j = (i + 1) % 3; 
+        ne_.es.push_back(inner(f.id, i)); 
+        ne_.es.push_back(inner(f.id, j)); 
+        ne_.fs.push_back(4 * f.id + i); 
+        ne_.fs.push_back(4 * f.id + j); 
+        ne_.fs.push_back(4 * f.id + 3); 
+      }
+    }
+  }); 
+  vector<Edge> newEdges(2 * ne + 3 * nf, Edge(-1, { -1, -1 }, { -1, -1 })); 
+  parallelFor(ne, [&] (int begin, int end) {
+    for (int e = begin; e < end; e++) {
+      // each half of e borders the corners at its end of the 
+      // faces on either side of e. 
+      auto &pe = edges[e]; 
+      for (int k = 0; k < 2; k++) 
+        newEdges[2 * e + k] = Edge(
+          2 * e + k, 
+          { pe.vs[k], nv + e }, 
+          { corner(pe.fs[0], pe.vs[k]), corner(pe.fs[1], pe.vs[k]) }
+        ); 
+    }
+  }); 
+  parallelFor(nf, [&] (int begin, int end) {
+    for (int f = begin; f < end; f++) 
+      for (int i = 0; i < 3; i++) 
+        newEdges[inner(f, i)] = Edge(
+          inner(f, i), 
+          { nv + faces[f].es[i], nv + faces[f].es[(i + 2) % 3] }, 
+          { 4 * f + i, 4 * f + 3 }
+        ); 
+  }); 
+
+  vector<Face> newFaces(4 * nf, Face(-1, { -1, -1, -1 }, { -1, -1, -1 })); 
+  parallelFor(nf, [&] (int begin, int end) {
+    for (int fi = begin; fi < end; fi++) {
+      auto &f = faces[fi]; 
+      // Children are wound like their parent, which read() has
+      // oriented. The faces containing one `even` vertex
+      // and 2 `odd` vertices. 
+      for (int i = 0; i < 3; i++) {
+        int vi = f.vs[i], ea = f.es[i], eb = f.es[(i + 2) % 3]; 
+        newFaces[4 * fi + i] = Face(
+          4 * fi + i, 
+          { vi, nv + ea, nv + eb }, 
+          { half(ea, vi), inner(fi, i), half(eb, vi) }
+        ); 
+      }
+      // the face containing 3 `odd` vertices
+      newFaces[4 * fi + 3] = Face(
+        4 * fi + 3, 
+        { nv + f.es[0], nv + f.es[1], nv + f.es[2] }, 
+        { inner(fi, 1), inner(fi, 2), inner(fi, 0) }
+      ); 
+    }
+  }); 
 
-  // update the positions for all vertices
-  for (int i = 0; i < nv; i++)
-    vertices[i].geom = even[i];
-  for (int i = 0; i < ne; i++) 
-    vertices[nv + i].geom = odd[i]; 
+  vertices.swap(newVertices); 
+  geom.swap(refined); 
+  edges.swap(newEdges); 
+  faces.swap(newFaces); 
+  halfEdges.build(faces, edges, vertices.size()); 
 }; 
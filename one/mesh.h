@@ -13,7 +13,7 @@
 
 using namespace std;
 
-typedef set<int> SI; 
+typedef vector<int> VI; 
 typedef initializer_list<int> Ini; 
 typedef initializer_list<float> IniF; 
 typedef pair<int, int> P; 
@@ -30,25 +30,50 @@ struct VertexGeometry {
 
 VertexGeometry linearCombination(const vector<VertexGeometry> &geoms, vector<float> cs); 
 
+// Positions and normals of all the vertices of a mesh, one array
+// per component. The subdivision passes gather from and stream into
+// these, so they touch 24 bytes per vertex instead of a whole Vertex.
+struct VertexArrays {
+  vector<float> x, y, z; 
+  vector<float> nx, ny, nz; 
+
+  int size () const { return x.size(); }
+
+  void resize (int n); 
+
+  void swap (VertexArrays &o); 
+
+  Vector4f position (int v) const { return Vector4f(x[v], y[v], z[v], 1.f); }
+
+  Vector4f normal (int v) const { return Vector4f(nx[v], ny[v], nz[v], 1.f); }
+
+  VertexGeometry get (int v) const { return VertexGeometry(position(v), normal(v)); }
+
+  void set (int v, const VertexGeometry &g); 
+
+  // normalize the normals of vertices [begin, end)
+  void normalize (int begin, int end); 
+};
+
 struct Vertex {
   int id;
-  VertexGeometry geom; 
-  SI fs, es;
+  VI fs, es;
 
-  Vertex(int id, VertexGeometry geom); 
+  Vertex(int id); 
 
-  Vertex(int id, VertexGeometry geom, SI &fs); 
+  Vertex(int id, VI &fs); 
 
-  Vertex(int id, VertexGeometry geom, SI &fs, SI &es); 
+  Vertex(int id, VI &fs, VI &es); 
 
-  bool hasFace (int f); 
+  bool hasFace (int f) const; 
 
-  bool hasEdge (int e); 
+  bool hasEdge (int e) const; 
 
   void print(); 
 };
 
 struct Face {
+  // es[i] is the edge running from vs[i] to vs[(i + 1) % 3]
   int id; 
   int vs[3], es[3];
 
@@ -56,9 +81,9 @@ struct Face {
 
   Face (int id, Ini vvs, Ini ees);
 
-  bool hasVert (int v); 
+  bool hasVert (int v) const; 
 
-  bool hasEdge (int e); 
+  bool hasEdge (int e) const; 
 
   void print();
 }; 
@@ -71,38 +96,144 @@ struct Edge {
 
   Edge (int id, Ini vvs, Ini ffs);
 
-  int v(int u); 
+  int v(int u) const; 
 
-  bool hasVert(int u);
+  bool hasVert(int u) const;
 
-  bool hasFace(int f); 
+  bool hasFace(int f) const; 
 
   bool operator < (const Edge &t) const; 
 
   void print();
 };
 
+// Index based half-edge connectivity. Half-edge 3 * f + i belongs
+// to face f and runs from its i'th corner to the next one, so next,
+// prev and face are arithmetic and everything else lives in flat
+// arrays of known size: 3F half-edges, V vertices and E edges.
+struct HalfEdgeMesh {
+  vector<int> origin;     // vertex each half-edge starts from
+  vector<int> twin;       // half-edge on the other side, -1 on a boundary
+  vector<int> edge;       // undirected edge each half-edge lies on
+  vector<int> vertexHalf; // some half-edge touching each vertex
+  vector<int> edgeHalf;   // some half-edge lying on each edge
+
+  static int next (int h) { return (h % 3 == 2) ? h - 2 : h + 1; }
+
+  static int prev (int h) { return (h % 3 == 0) ? h + 2 : h - 1; }
+
+  int dest (int h) const { return origin[next(h)]; }
+
+  // vertex of h's face that isn't on h
+  int opposite (int h) const { return origin[prev(h)]; }
+
+  void build (const vector<Face> &faces, const vector<Edge> &edges, int nv); 
+
+  // Call f(w) for each neighbour w of v by walking the faces around
+  // v. O(valence), and doesn't care how the faces around v are wound.
+  // Returns the valence.
+  template <typename F>
+  int forOneRing (int v, F f) const {
+    int start = vertexHalf[v], h = start, valence = 0;
+    do {
+      bool out = (origin[h] == v); 
+      f(out ? dest(h) : origin[h]); 
+      valence++; 
+      // step to the other half-edge of this face that touches v
+      // and cross over to the neighbouring face. 
+      h = twin[out ? prev(h) : next(h)]; 
+    } while (h != start && h >= 0); 
+    return valence; 
+  }
+};
+
+// How much closure() checks of the mesh it builds. CHEAP is O(1)
+// per element: ids, ranges, face/edge agreement and that the mesh
+// is closed and manifold, and is what meshes do by default. FULL
+// also checks every adjacency list.
+enum Validation { VALIDATE_OFF, VALIDATE_CHEAP, VALIDATE_FULL }; 
+
+const Validation DEFAULT_VALIDATION = VALIDATE_CHEAP; 
+
 struct Mesh {
-  // To render stuff on OpenGL, you need oriented faces
-  // that is why people use the half-edge data-structure. 
-  // Unfortunately, I don't have this luxury, I don't know
-  // what the half-edge data-structure is. So I'm going to
-  // improvise.
+  // Faces, edges and vertices refer to each other by index. 
+  // halfEdges adds the oriented view: half-edge 3f + i runs along
+  // faces[f].es[i], with its twin and edge in flat arrays, so 
+  // one-rings are walked without lookups.
   vector<Vertex> vertices;
   vector<Face> faces;
   vector<Edge> edges; 
+  HalfEdgeMesh halfEdges; 
+  VertexArrays geom; 
+  Validation validation = DEFAULT_VALIDATION; 
 
   void loopSubdivide (); 
 
+  // Refine only the faces whose corner normals are more than 
+  // `angle` radians apart or, if `size` > 0, whose longest edge
+  // subtends more than `size` radians seen from `eye`. Neighbours
+  // are bisected so that no T-junctions are left. Returns the 
+  // number of faces split in four, or -1 if the result fails 
+  // validation, in which case the mesh is left as it was.
+  int adaptiveSubdivide (float angle, float size = 0, Vector3f eye = Vector3f()); 
+
+  // Same result as calling loopSubdivide `levels` times, but each
+  // coarse face is refined as a regular grid with fixed masks, and
+  // only the coarse vertices go through their own one-rings.
+  void patchSubdivide (int levels); 
+
+  // Move every vertex onto the limit surface and give it the exact
+  // limit normal, using closed form Loop limit masks. 
+  void limitProject (); 
+
+  // Evaluate the limit surface at (u, v) on face f, where u weighs
+  // vs[1], v weighs vs[2] and the rest goes to vs[0]. Only faces 
+  // whose corners all have valence 6 are supported; returns false
+  // for the others.
+  bool evalLimit (int f, float u, float v, Vector3f &P, Vector3f &N) const; 
+
   void draw(); 
 
   bool read(ifstream &in); 
 
-  void _orient (Face &a, Face &b); 
+  // Make all faces wind the same way as their neighbours and face 
+  // out of the volume they enclose. Done once by read; every kind
+  // of subdivision then hands the winding down to the children.
+  void orient (); 
+
+  // Write the mesh as an OBJ with per vertex normals or, if 
+  // binary, as a binary little endian PLY. 
+  void write (ostream &out, bool binary = false) const; 
+
+  // Write what loopSubdivide would make of this mesh, without 
+  // building it: the refined vertices are computed a chunk at a 
+  // time and the faces come straight from this level's ids, so 
+  // memory stays at the size of this level.
+  void writeSubdivided (ostream &out, bool binary = false) const; 
+
+
+  int _ring (int v, int a, int b, int *ring, int maxValence) const; 
+
+  // Loop masks of even vertex v and of the odd vertex on edge e,
+  // written to slot i of out. Normals are left unnormalized.
+  void _evenGeometry (int v, VertexArrays &out, int i) const; 
+
+  void _oddGeometry (int e, VertexArrays &out, int i) const; 
+
+  bool _needsRefinement (int f, float angle, float size, Vector3f eye) const; 
+
+  // Check the mesh at the given level, reporting the first problem
+  // found on cerr.
+  bool validate (Validation level) const; 
+
+  bool consistent () const { return validate(VALIDATE_FULL); }
 
-  bool consistent (); 
+  // Rebuild edges, face edges, vertex adjacency and half-edges 
+  // from the vertex ids of the faces, then validate the result. 
+  // Returns false if the mesh isn't closed and manifold or fails.
+  bool closure (); 
 
-  void closure (); 
+  void _adjacency (); 
 
 }; 
 
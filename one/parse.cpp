@@ -1,4 +1,7 @@
 #include "parse.h"
+#include "pool.h"
+#include <cstring>
+#include <functional>
 #include <map>
 using namespace std;
 
@@ -9,7 +12,7 @@ namespace {
   vector<Vector3f> readCps(istream &in, unsigned dim)
   {    
     // number of control points    
-    unsigned n;
+    unsigned n = 0;
     in >> n;
 
     cerr << "  " << n << " cps" << endl;
@@ -52,18 +55,41 @@ namespace {
 
 
 
-bool parseFile(istream &in,
-    vector<vector<Vector3f> > &ctrlPoints, 
-    vector<Curve>             &curves,
-    vector<string>            &curveNames,
-    vector<Surface>           &surfaces,
-    vector<string>            &surfaceNames)
+namespace {
+  bool uniformSweep = false;
+}
+
+void setUniformSweep(bool on)
 {
-  ctrlPoints.clear();
-  curves.clear();
-  curveNames.clear();
-  surfaces.clear();
-  surfaceNames.clear();    
+  uniformSweep = on;
+}
+
+Curve evalCurve(const SwpObject &o)
+{
+  // circles are evenly spaced already
+  if (o.type == "circ")
+    return evalCircle(o.radius, o.steps);
+  bool bez = (o.type == "bez2" || o.type == "bez3");
+  if (uniformSweep && o.swept && o.cps.size() >= 4)
+  {
+    // evalBezier and evalBspline give steps + 1 points per piece
+    int pieces = bez ? (o.cps.size() - 1) / 3 : o.cps.size() - 3;
+    unsigned n = pieces * (o.steps + 1) - 1;
+    return bez ? evalBezierUniform(o.cps, n) : evalBsplineUniform(o.cps, n);
+  }
+  return bez ? evalBezier(o.cps, o.steps) : evalBspline(o.cps, o.steps);
+}
+
+Surface evalSurface(const SwpObject &o, const vector<Curve> &curves)
+{
+  if (o.type == "srev")
+    return makeSurfRev(curves[o.profile], o.steps);
+  return makeGenCyl(curves[o.profile], curves[o.sweep]);
+}
+
+bool readSwp(istream &in, vector<SwpObject> &objects)
+{
+  objects.clear();
 
   string objType;
 
@@ -73,10 +99,11 @@ bool parseFile(istream &in,
   // For looking up surface indices by name
   map<string,unsigned> surfaceIndex;
 
-  // For storing dimension of curve
+  // For storing dimension of curve, and where it is in objects
   vector<unsigned> dims;
+  vector<int> curveObjects;
 
-  unsigned counter = 0;
+  unsigned counter = 0, nsurfaces = 0;
 
   while (in >> objType) 
   {
@@ -86,8 +113,6 @@ bool parseFile(istream &in,
 
     bool named = (objName != ".");
 
-    vector<Vector3f> cpsToAdd;
-
     if (curveIndex.find(objName) != curveIndex.end() ||
         surfaceIndex.find(objName) != surfaceIndex.end())
     {
@@ -95,50 +120,32 @@ bool parseFile(istream &in,
       return false;
     }
 
-    unsigned steps;
-
-    if (objType == "bez2")
-    {
-      in >> steps;
-      cerr << " reading bez2 " << "[" << objName << "]" << endl;
-      curves.push_back( evalBezier(cpsToAdd = readCps(in, 2), steps) );
-      curveNames.push_back(objName);
-      dims.push_back(2);
-      if (named) curveIndex[objName] = dims.size()-1;
-
-    }
-    else if (objType == "bsp2")
-    {
-      cerr << " reading bsp2 " << "[" << objName << "]" << endl;
-      in >> steps;
-      curves.push_back( evalBspline(cpsToAdd = readCps(in, 2), steps) );
-      curveNames.push_back(objName);
-      dims.push_back(2);
-      if (named) curveIndex[objName] = dims.size()-1;
-    }
-    else if (objType == "bez3")
-    {
-      cerr << " reading bez3 " << "[" << objName << "]" << endl;
-      in >> steps;
-      curves.push_back( evalBezier(cpsToAdd = readCps(in, 3), steps) );
-      curveNames.push_back(objName);
-      dims.push_back(3);
-      if (named) curveIndex[objName] = dims.size()-1;
+    SwpObject o;
+    o.type = objType;
+    o.name = objName;
 
-    }
-    else if (objType == "bsp3")
+    if (objType == "bez2" || objType == "bsp2" ||
+        objType == "bez3" || objType == "bsp3")
     {
-      cerr << " reading bsp3 " << "[" << objName << "]" << endl;
-      in >> steps;
-      curves.push_back( evalBspline(cpsToAdd = readCps(in, 3), steps) );
-      curveNames.push_back(objName);
-      dims.push_back(3);
-      if (named) curveIndex[objName] = dims.size()-1;
+      cerr << " reading " << objType << " " << "[" << objName << "]" << endl;
+      o.dim = objType[3] - '0';
+      in >> o.steps;
+      o.cps = readCps(in, o.dim);
+
+      // evalBezier and evalBspline give up on these with exit(), so
+      // they are caught here, where a file being edited can be
+      // rejected and the last good version kept.
+      bool bez = (objType[1] == 'e');
+      if (o.cps.size() < 4 || (bez && o.cps.size() % 3 != 1)) {
+        cerr << "failed: [" << objName << "] needs " 
+          << (bez ? "3n+1, and at least 4," : "at least 4") << " control points" << endl;
+        return false;
+      }
     }
     else if (objType == "srev")
     {
       cerr << " reading srev " << "[" << objName << "]" << endl;
-      in >> steps;
+      in >> o.steps;
 
       // Name of the profile curve
       string profName;
@@ -155,11 +162,7 @@ bool parseFile(istream &in,
       if (dims[it->second] != 2) {
         cerr << "failed: [" << profName << "] isn't 2d!" << endl; return false;
       }
-
-      // Make the surface
-      surfaces.push_back( makeSurfRev( curves[it->second], steps ) );
-      surfaceNames.push_back(objName);
-      if (named) surfaceIndex[objName] = surfaceNames.size()-1;
+      o.profile = it->second;
     }
     else if (objType == "gcyl")
     {
@@ -188,26 +191,17 @@ bool parseFile(istream &in,
       if (itS == curveIndex.end()) {                
         cerr << "failed: [" << sweepName << "] doesn't exist!" << endl; return false;
       }
-
-      // Make the surface
-      surfaces.push_back( makeGenCyl( curves[itP->second], curves[itS->second] ) );
-      surfaceNames.push_back(objName);
-      if (named) surfaceIndex[objName] = surfaceNames.size()-1;
-
+      o.profile = itP->second;
+      o.sweep = itS->second;
+      objects[curveObjects[o.sweep]].swept = true;
     }
     else if (objType == "circ")
     {
       cerr << " reading circ " << "[" << objName << "]" << endl;
 
-      unsigned steps;
-      float rad;
-      in >> steps >> rad;
-      cerr << "  radius [" << rad << "]" << endl;
-
-      curves.push_back( evalCircle(rad, steps) );
-      curveNames.push_back(objName);
-      dims.push_back(2);
-      if (named) curveIndex[objName] = dims.size()-1;
+      in >> o.steps >> o.radius;
+      cerr << "  radius [" << o.radius << "]" << endl;
+      o.dim = 2;
     }
     else
     {
@@ -215,12 +209,190 @@ bool parseFile(istream &in,
       return false;
     }
 
-    ctrlPoints.push_back(cpsToAdd);
+    if (!in)
+    {
+      cerr << "failed: [" << objName << "] is cut short" << endl;
+      return false;
+    }
+
+    if (o.isCurve())
+    {
+      o.index = dims.size();
+      dims.push_back(o.dim);
+      curveObjects.push_back(objects.size());
+      if (named) curveIndex[objName] = o.index;
+    }
+    else
+    {
+      o.index = nsurfaces++;
+      if (named) surfaceIndex[objName] = o.index;
+    }
+    objects.push_back(o);
   }
 
   return true;
 }
 
+namespace {
 
+  // Moves the items of old whose hashes appear again in hashes to
+  // their new places in items. Returns where each item came from in
+  // old, or -1 for the ones that still have to be evaluated.
+  template <class T>
+  vector<int> carryOver(vector<T> &old, const vector<size_t> &oldHashes,
+      const vector<size_t> &hashes, vector<T> &items)
+  {
+    map<size_t, int> byHash;
+    for (unsigned i=0; i<old.size() && i<oldHashes.size(); i++)
+      byHash[oldHashes[i]] = i;
+    vector<bool> kept(old.size(), false);
+    vector<int> sources(hashes.size(), -1);
+    for (unsigned i=0; i<hashes.size(); i++)
+    {
+      map<size_t, int>::const_iterator it = byHash.find(hashes[i]);
+      if (it == byHash.end() || kept[it->second])
+        continue;
+      kept[it->second] = true;
+      items[i] = move(old[it->second]);
+      sources[i] = it->second;
+    }
+    return sources;
+  }
+}
 
+void evalSwp(const vector<SwpObject> &objects,
+    vector<vector<Vector3f> > &ctrlPoints, 
+    vector<Curve>             &curves,
+    vector<string>            &curveNames,
+    vector<Surface>           &surfaces,
+    vector<string>            &surfaceNames,
+    SwpReuse                  *reuse)
+{
+  ctrlPoints.clear();
+  curveNames.clear();
+  surfaceNames.clear();    
+
+  // Surfaces only ever refer to curves, so the dependency graph has
+  // two levels: every curve can be evaluated at once, and then every
+  // surface.
+  vector<const SwpObject *> cs, ss;
+  for (auto &o : objects)
+  {
+    ctrlPoints.push_back(o.cps);
+    if (o.isCurve())
+    {
+      cs.push_back(&o);
+      curveNames.push_back(o.name);
+    }
+    else
+    {
+      ss.push_back(&o);
+      surfaceNames.push_back(o.name);
+    }
+  }
 
+  vector<Curve> newCurves(cs.size());
+  vector<Surface> newSurfaces(ss.size());
+  vector<int> curveSources(cs.size(), -1), surfaceSources(ss.size(), -1);
+  if (reuse)
+  {
+    vector<size_t> curveHashes, surfaceHashes;
+    hashSwp(objects, curveHashes, surfaceHashes);
+    curveSources = carryOver(curves, reuse->curveHashes, curveHashes, newCurves);
+    surfaceSources = carryOver(surfaces, reuse->surfaceHashes, surfaceHashes, newSurfaces);
+    reuse->curveHashes.swap(curveHashes);
+    reuse->surfaceHashes.swap(surfaceHashes);
+  }
+
+  vector<int> todoC, todoS;
+  for (unsigned i=0; i<cs.size(); i++)
+    if (curveSources[i] < 0)
+      todoC.push_back(i);
+  for (unsigned i=0; i<ss.size(); i++)
+    if (surfaceSources[i] < 0)
+      todoS.push_back(i);
+  parallelFor(todoC.size(), [&](int begin, int end) {
+    for (int k = begin; k < end; k++)
+      newCurves[todoC[k]] = evalCurve(*cs[todoC[k]]);
+  }, 1);
+  parallelFor(todoS.size(), [&](int begin, int end) {
+    for (int k = begin; k < end; k++)
+      newSurfaces[todoS[k]] = evalSurface(*ss[todoS[k]], newCurves);
+  }, 1);
+  if (reuse)
+  {
+    cerr << "evaluated " << todoC.size() << " of " << cs.size() << " curves, "
+      << todoS.size() << " of " << ss.size() << " surfaces" << endl;
+    reuse->curveSources.swap(curveSources);
+    reuse->surfaceSources.swap(surfaceSources);
+  }
+  curves.swap(newCurves);
+  surfaces.swap(newSurfaces);
+}
+
+namespace {
+
+  size_t combine(size_t h, size_t x)
+  {
+    return h ^ (x + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2));
+  }
+
+  size_t hashFloat(float x)
+  {
+    unsigned bits;
+    memcpy(&bits, &x, sizeof(bits));
+    return bits;
+  }
+
+  // What an object is evaluated from, apart from the curves it uses.
+  size_t hashDefinition(const SwpObject &o)
+  {
+    size_t h = hash<string>()(o.type);
+    h = combine(h, o.steps);
+    h = combine(h, uniformSweep && o.swept);
+    h = combine(h, hashFloat(o.radius));
+    for (auto &p : o.cps)
+      for (int d = 0; d < 3; d++)
+        h = combine(h, hashFloat(p[d]));
+    return h;
+  }
+}
+
+void hashSwp(const vector<SwpObject> &objects,
+    vector<size_t> &curveHashes, vector<size_t> &surfaceHashes)
+{
+  curveHashes.clear();
+  surfaceHashes.clear();
+  for (auto &o : objects)
+  {
+    size_t h = hashDefinition(o);
+    if (o.isCurve())
+      curveHashes.push_back(h);
+    else
+    {
+      h = combine(h, curveHashes[o.profile]);
+      if (o.sweep >= 0)
+        h = combine(h, curveHashes[o.sweep]);
+      surfaceHashes.push_back(h);
+    }
+  }
+}
+
+bool parseFile(istream &in,
+    vector<vector<Vector3f> > &ctrlPoints, 
+    vector<Curve>             &curves,
+    vector<string>            &curveNames,
+    vector<Surface>           &surfaces,
+    vector<string>            &surfaceNames)
+{
+  vector<SwpObject> objects;
+  ctrlPoints.clear();
+  curves.clear();
+  curveNames.clear();
+  surfaces.clear();
+  surfaceNames.clear();    
+  if (!readSwp(in, objects))
+    return false;
+  evalSwp(objects, ctrlPoints, curves, curveNames, surfaces, surfaceNames);
+  return true;
+}
@@ -59,6 +59,72 @@
    SWEEP is the name of a 2D *or* 3D curve.
    */
 
+// One object of a SWP file as read, before anything is evaluated.
+// Curves keep their control points (or, for circles, the radius);
+// surfaces keep the curve numbers of their profile and sweep, ie.
+// their position among the curves of the file.
+struct SwpObject
+{
+  std::string type, name;
+  unsigned steps = 0, dim = 0;
+  float radius = 0;
+  std::vector<Vector3f> cps;
+  int profile = -1, sweep = -1;
+  // whether some generalized cylinder is swept along this curve
+  bool swept = false;
+  // position among the curves, or among the surfaces, of the file
+  int index = -1;
+
+  bool isCurve() const { return type != "srev" && type != "gcyl"; }
+};
+
+// Reads the objects of a SWP file and resolves the names they refer
+// to, without evaluating anything. Returns false on a format error.
+bool readSwp(std::istream &in, std::vector<SwpObject> &objects);
+
+// When on, curves that generalized cylinders are swept along are
+// sampled at evenly spaced arc lengths (evalBezierUniform), with as
+// many points as their steps would give, so the rings of the surface
+// stay evenly spaced where the curve's parametric speed drops.
+void setUniformSweep(bool on);
+
+// Evaluates one curve, or one surface from the evaluated curves.
+Curve evalCurve(const SwpObject &o);
+Surface evalSurface(const SwpObject &o, const std::vector<Curve> &curves);
+
+// Lets evalSwp reuse what an earlier call evaluated. Going in,
+// curveHashes and surfaceHashes are the hashes (see hashSwp) of the
+// curves and surfaces passed to evalSwp; coming out they are those
+// of the new ones, and curveSources[i] is the old position curve i
+// was carried over from, or -1 if it was evaluated. Likewise for
+// surfaceSources.
+struct SwpReuse
+{
+  std::vector<size_t> curveHashes, surfaceHashes;
+  std::vector<int> curveSources, surfaceSources;
+};
+
+// Evaluates the objects read by readSwp on the thread pool, all the
+// curves and then all the surfaces, into the same arrays as
+// parseFile. Given reuse, the curves and surfaces whose hashes are
+// unchanged are moved over from the ones passed in instead.
+void evalSwp(const std::vector<SwpObject> &objects,
+    std::vector<std::vector<Vector3f> > &ctrlPoints, 
+    std::vector<Curve>                  &curves,     
+    std::vector<std::string>            &curveNames, 
+    std::vector<Surface>                &surfaces,   
+    std::vector<std::string>            &surfaceNames,
+    SwpReuse                            *reuse = 0 );
+
+// Hashes of what each curve, and each surface, of objects would be
+// evaluated from. A surface's hash covers the curves it uses, so two
+// equal hashes mean the same result (up to collisions), whatever the
+// names or positions of the objects in the file.
+void hashSwp(const std::vector<SwpObject> &objects,
+    std::vector<size_t> &curveHashes, std::vector<size_t> &surfaceHashes);
+
+// readSwp followed by evalSwp.
+//
 // The vectors are passed in by reference.  parseFile actually writes
 // to these variables.  This is how we pull off a multiple
 // return-value function.
@@ -0,0 +1,295 @@
+#include "mesh.h"
+#include "pool.h"
+#include <cmath>
+
+using namespace std; 
+
+namespace
+{
+  const int COMPONENTS = 6; 
+
+  // Each coarse face is refined as a triangular grid of resolution
+  // n, whose point (i, j) sits at i / n of the way to vs[1] and
+  // j / n of the way to vs[2]. A grid is stored in an (n + 3)^2
+  // square with a ring of ghost points copied from the neighbouring
+  // grids. That way every point but the three corners has its whole
+  // one-ring at fixed offsets, so it gets the valence 6 masks.
+  struct Grids {
+    int n, w; 
+    vector<float> c[COMPONENTS]; // x, y, z, nx, ny, nz
+
+    void resize (int patches, int res) {
+      n = res; 
+      w = n + 3; 
+      for (auto &a : c)
+        a.resize((size_t) patches * w * w); 
+    }
+
+    int at (int p, int i, int j) const { return (p * w + i + 1) * w + j + 1; }
+  }; 
+
+  // Grid coordinates of the point s steps along edge k of a grid
+  // and t rows in from it. Edge k runs from vs[k] to vs[k + 1].
+  void local (int n, int k, int s, int t, int &i, int &j) {
+    if (k == 0) { i = s; j = t; }
+    else if (k == 1) { i = n - s - t; j = s; }
+    else { i = t; j = n - s - t; }
+  }
+
+  int localAt (const Grids &g, int p, int k, int s, int t) {
+    int i, j; 
+    local(g.n, k, s, t, i, j); 
+    return g.at(p, i, j); 
+  }
+}
+
+void Mesh::patchSubdivide (int levels) {
+  int nv = vertices.size(), ne = edges.size(), nf = faces.size(); 
+  Grids a, b; 
+  a.resize(nf, 1); 
+  for (int f = 0; f < nf; f++)
+    for (int k = 0; k < 3; k++) {
+      int v = faces[f].vs[k], p = localAt(a, f, k, 0, 0); 
+      a.c[0][p] = geom.x[v];  a.c[1][p] = geom.y[v];  a.c[2][p] = geom.z[v]; 
+      a.c[3][p] = geom.nx[v]; a.c[4][p] = geom.ny[v]; a.c[5][p] = geom.nz[v]; 
+    }
+
+  // index of edge e in face g
+  auto side = [&] (int g, int e) {
+    const int *es = faces[g].es; 
+    return (int) (find(es, es + 3, e) - es); 
+  }; 
+
+  for (int l = 0; l < levels; l++) {
+    int n = a.n, m = 2 * n; 
+
+    // Take the points on each edge from the face that owns it, so
+    // both sides agree to the bit, then copy the row next to each
+    // edge of the neighbour into the ghost row. 
+    auto across = [&] (int f, int k, int &g, int &kg, bool &flip) {
+      int e = faces[f].es[k]; 
+      g = edges[e].fs[0] == f ? edges[e].fs[1] : edges[e].fs[0]; 
+      kg = side(g, e); 
+      // the neighbour runs along the edge the other way, unless 
+      // the two faces are wound differently
+      flip = faces[g].vs[kg] == faces[f].vs[k]; 
+    }; 
+    parallelFor(nf, [&] (int begin, int end) {
+      for (int f = begin; f < end; f++) 
+        for (int k = 0; k < 3; k++) {
+          int g, kg; 
+          bool flip; 
+          across(f, k, g, kg, flip); 
+          if (edges[faces[f].es[k]].fs[0] != g) 
+            continue; 
+          for (int s = 1; s < n; s++) {
+            int dst = localAt(a, f, k, s, 0), src = localAt(a, g, kg, flip ? s : n - s, 0); 
+            for (auto &c : a.c) 
+              c[dst] = c[src]; 
+          }
+        }
+    }); 
+    parallelFor(nf, [&] (int begin, int end) {
+      for (int f = begin; f < end; f++) 
+        for (int k = 0; k < 3; k++) {
+          int g, kg; 
+          bool flip; 
+          across(f, k, g, kg, flip); 
+          for (int s = 1; s <= n; s++) {
+            int dst = localAt(a, f, k, s, -1), src = localAt(a, g, kg, flip ? s - 1 : n - s, 1); 
+            for (auto &c : a.c) 
+              c[dst] = c[src]; 
+          }
+        }
+    }); 
+
+    // Refine every row of every grid with the regular masks. Old
+    // point (i, j) becomes (2i, 2j) and the odd points land in
+    // between. The corners come out wrong and are redone below.
+    b.resize(nf, m); 
+    parallelFor(nf * (n + 1), [&] (int begin, int end) {
+      for (int task = begin; task < end; task++) {
+        int p = task / (n + 1), i = task % (n + 1); 
+        for (int ci = 0; ci < COMPONENTS; ci++) {
+          const float *r0 = &a.c[ci][a.at(p, i, 0)]; 
+          const float *rp = r0 + a.w, *rm = r0 - a.w; 
+          float *E = &b.c[ci][b.at(p, 2 * i, 0)], *O = E + b.w; 
+          for (int j = 0; j <= n - i; j++)
+            E[2 * j] = (5.f / 8.f) * r0[j] + (1.f / 16.f) *
+              (rp[j] + rm[j] + r0[j + 1] + r0[j - 1] + rp[j - 1] + rm[j + 1]); 
+          for (int j = 0; j < n - i; j++) {
+            E[2 * j + 1] = (3.f / 8.f) * (r0[j] + r0[j + 1]) + (1.f / 8.f) * (rp[j] + rm[j + 1]); 
+            O[2 * j]     = (3.f / 8.f) * (r0[j] + rp[j]) + (1.f / 8.f) * (r0[j + 1] + rp[j - 1]); 
+            O[2 * j + 1] = (3.f / 8.f) * (rp[j] + r0[j + 1]) + (1.f / 8.f) * (r0[j] + rp[j + 1]); 
+          }
+        }
+      }
+    }); 
+
+    // The corners are the coarse vertices and may have any valence.
+    // Each face around one adds the next point along its edge k to
+    // the ring.
+    parallelFor(nv, [&] (int begin, int end) {
+      for (int v = begin; v < end; v++) {
+        auto &fs = vertices[v].fs; 
+        int valence = fs.size(); 
+        float BETA = 3.f / ((valence > 3) ? 8.f * valence : 16.f); 
+        float self = 1.f - (BETA * valence); 
+        int k0 = find(faces[fs[0]].vs, faces[fs[0]].vs + 3, v) - faces[fs[0]].vs; 
+        int center = localAt(a, fs[0], k0, 0, 0); 
+        for (auto &c : a.c) {
+          float sum = 0; 
+          for (int f : fs) {
+            int k = find(faces[f].vs, faces[f].vs + 3, v) - faces[f].vs; 
+            sum += c[localAt(a, f, k, 1, 0)]; 
+          }
+          float value = BETA * sum + self * c[center]; 
+          auto &out = b.c[&c - a.c]; 
+          for (int f : fs) {
+            int k = find(faces[f].vs, faces[f].vs + 3, v) - faces[f].vs; 
+            out[localAt(b, f, k, 0, 0)] = value; 
+          }
+        }
+      }
+    }); 
+
+    parallelFor(nf * (m + 1), [&] (int begin, int end) {
+      for (int task = begin; task < end; task++) {
+        int p = task / (m + 1), i = task % (m + 1); 
+        float *x = &b.c[3][b.at(p, i, 0)], *y = &b.c[4][b.at(p, i, 0)], *z = &b.c[5][b.at(p, i, 0)]; 
+        for (int j = 0; j <= m - i; j++) {
+          float len = 1.f / sqrt(x[j] * x[j] + y[j] * y[j] + z[j] * z[j]); 
+          x[j] *= len; 
+          y[j] *= len; 
+          z[j] *= len; 
+        }
+      }
+    }); 
+    swap(a, b); 
+  }
+
+  // Stitch the grids into one mesh, numbering everything so that
+  // it needs no lookups. Coarse vertices keep their ids, then come
+  // the points inside each coarse edge and then the ones inside 
+  // each coarse face. Edges go the same way: the n pieces of each 
+  // coarse edge, then per face three families of n (n - 1) / 2, 
+  // one for each direction of the grid.
+  int n = a.n, perEdge = n - 1, perFace = (n - 1) * (n - 2) / 2, perDir = n * (n - 1) / 2; 
+
+  // coarse edge k of a face that grid point (i, j) lies on, and how
+  // far along it, or -1 inside the face
+  auto onEdge = [&] (int i, int j, int &s) {
+    if (j == 0) { s = i; return 0; }
+    if (i + j == n) { s = j; return 1; }
+    if (i == 0) { s = n - j; return 2; }
+    return -1; 
+  }; 
+  auto vertexId = [&] (int f, int i, int j) {
+    const Face &F = faces[f]; 
+    if (i == 0 && j == 0) return F.vs[0]; 
+    if (i == n) return F.vs[1]; 
+    if (j == n) return F.vs[2]; 
+    int s, k = onEdge(i, j, s); 
+    if (k >= 0) {
+      int e = F.es[k]; 
+      if (edges[e].vs[0] != F.vs[k]) 
+        s = n - s; 
+      return nv + e * perEdge + s - 1; 
+    }
+    // rows i = 1 .. n - 2 hold n - 1 - i points each
+    int row = (i - 1) * (n - 1) - (i - 1) * i / 2; 
+    return nv + ne * perEdge + f * perFace + row + j - 1; 
+  }; 
+  // the edge between neighbouring grid points (i, j) and (i2, j2)
+  auto edgeId = [&] (int f, int i, int j, int i2, int j2) {
+    int k = -1; 
+    if (j == 0 && j2 == 0) k = 0; 
+    else if (i + j == n && i2 + j2 == n) k = 1; 
+    else if (i == 0 && i2 == 0) k = 2; 
+    if (k >= 0) {
+      // same distances along edge k as onEdge, corners included
+      auto along = [&] (int i, int j) { return k == 0 ? i : k == 1 ? j : n - j; }; 
+      int s = along(i, j), s2 = along(i2, j2); 
+      int e = faces[f].es[k], q = min(s, s2); 
+      if (edges[e].vs[0] != faces[f].vs[k]) 
+        q = n - 1 - q; 
+      return e * n + q; 
+    }
+    int base = ne * n + 3 * f * perDir; 
+    if (j == j2) {
+      int jj = j, ii = min(i, i2); 
+      return base + (jj - 1) * n - (jj - 1) * jj / 2 + ii; 
+    }
+    if (i == i2) {
+      int ii = i, jj = min(j, j2); 
+      return base + perDir + (ii - 1) * n - (ii - 1) * ii / 2 + jj; 
+    }
+    int ii = min(i, i2), jj = min(j, j2); 
+    return base + 2 * perDir + ii * (n - 1) - ii * (ii - 1) / 2 + jj; 
+  }; 
+
+  int nv2 = nv + ne * perEdge + nf * perFace, ne2 = ne * n + 3 * nf * perDir; 
+  VertexArrays refined; 
+  refined.resize(nv2); 
+  vector<Face> newFaces(nf * n * n, Face(-1, { -1, -1, -1 })); 
+  vector<Edge> newEdges(ne2, Edge(-1, { -1, -1 }, { -1, -1 })); 
+  parallelFor(nf, [&] (int begin, int end) {
+    for (int f = begin; f < end; f++) {
+      for (int i = 0; i <= n; i++) 
+        for (int j = 0; i + j <= n; j++) {
+          int p = a.at(f, i, j), v = vertexId(f, i, j); 
+          // shared points are written by the first face around them
+          int s, k = onEdge(i, j, s); 
+          if (v < nv && vertices[v].fs[0] != f) 
+            continue; 
+          if (v >= nv && k >= 0 && edges[faces[f].es[k]].fs[0] != f) 
+            continue; 
+          refined.x[v]  = a.c[0][p]; refined.y[v]  = a.c[1][p]; refined.z[v]  = a.c[2][p]; 
+          refined.nx[v] = a.c[3][p]; refined.ny[v] = a.c[4][p]; refined.nz[v] = a.c[5][p]; 
+        }
+      // n^2 small faces wound like the coarse one. Every edge inside
+      // the grid has an upright face on one side (slot 0) and an
+      // upside down one on the other (slot 1); a piece of a coarse 
+      // edge takes the slot of its coarse face.
+      int t = f * n * n; 
+      auto add = [&] (int i0, int j0, int i1, int j1, int i2, int j2, bool up) {
+        int ij[3][2] = { { i0, j0 }, { i1, j1 }, { i2, j2 } }; 
+        Face &F = newFaces[t]; 
+        F.id = t; 
+        for (int c = 0; c < 3; c++) {
+          int *x = ij[c], *y = ij[(c + 1) % 3]; 
+          F.vs[c] = vertexId(f, x[0], x[1]); 
+          int e = edgeId(f, x[0], x[1], y[0], y[1]); 
+          F.es[c] = e; 
+          int slot = up ? 0 : 1; 
+          if (e < ne * n) 
+            slot = edges[e / n].fs[0] == f ? 0 : 1; 
+          Edge &E = newEdges[e]; 
+          E.fs[slot] = t; 
+          if (slot == 0) {
+            E.id = e; 
+            E.vs[0] = F.vs[c]; 
+            E.vs[1] = vertexId(f, y[0], y[1]); 
+          }
+        }
+        t++; 
+      }; 
+      for (int i = 0; i < n; i++) 
+        for (int j = 0; i + j < n; j++) {
+          add(i, j, i + 1, j, i, j + 1, true); 
+          if (i + j < n - 1) 
+            add(i + 1, j, i + 1, j + 1, i, j + 1, false); 
+        }
+    }
+  }); 
+
+  vertices.clear(); 
+  for (int v = 0; v < nv2; v++) 
+    vertices.emplace_back(v); 
+  geom.swap(refined); 
+  faces.swap(newFaces); 
+  edges.swap(newEdges); 
+  halfEdges.build(faces, edges, nv2); 
+
+  _adjacency(); 
+}
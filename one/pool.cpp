@@ -0,0 +1,92 @@
+#include "pool.h"
+#include <algorithm>
+using namespace std;
+
+namespace
+{
+  // Below this many indices per thread, threads cost more than
+  // they save.
+  const int MIN_CHUNK = 256; 
+}
+
+ThreadPool &ThreadPool::instance()
+{
+  static ThreadPool pool(max(1u, thread::hardware_concurrency())); 
+  return pool; 
+}
+
+ThreadPool::ThreadPool( int nThreads ) 
+  : mRunning(false), mBody(nullptr), mN(0), mChunk(1), mNext(0), mBusy(0), mGeneration(0), mStop(false)
+{
+  for (int i = 1; i < nThreads; i++) 
+    mWorkers.emplace_back(&ThreadPool::work, this); 
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    lock_guard<mutex> lock(mMutex); 
+    mStop = true; 
+  }
+  mWake.notify_all(); 
+  for (auto &w : mWorkers) 
+    w.join(); 
+}
+
+void ThreadPool::runChunks()
+{
+  for (int b = mNext.fetch_add(mChunk); b < mN; b = mNext.fetch_add(mChunk)) 
+    (*mBody)(b, min(mN, b + mChunk)); 
+}
+
+void ThreadPool::work()
+{
+  unsigned seen = 0; 
+  while (true) 
+  {
+    {
+      unique_lock<mutex> lock(mMutex); 
+      mWake.wait(lock, [&] { return mStop || mGeneration != seen; }); 
+      if (mStop) 
+        return; 
+      seen = mGeneration; 
+    }
+    runChunks(); 
+    {
+      lock_guard<mutex> lock(mMutex); 
+      if (--mBusy == 0) 
+        mDone.notify_one(); 
+    }
+  }
+}
+
+void ThreadPool::parallelFor( int n, const function<void(int, int)> &body, int grain )
+{
+  if (n <= 0) 
+    return; 
+  // Small ranges aren't worth waking anybody up for, and a job
+  // started from inside another one runs on the calling thread.
+  int minChunk = grain > 0 ? grain : MIN_CHUNK; 
+  bool idle = false; 
+  if (mWorkers.empty() || n < 2 * minChunk || 
+      !mRunning.compare_exchange_strong(idle, true)) 
+  {
+    body(0, n); 
+    return; 
+  }
+  {
+    lock_guard<mutex> lock(mMutex); 
+    mBody = &body; 
+    mN = n; 
+    // a few chunks per thread so that uneven work balances out
+    mChunk = max(minChunk, n / (4 * size())); 
+    mNext = 0; 
+    mBusy = mWorkers.size(); 
+    mGeneration++; 
+  }
+  mWake.notify_all(); 
+  runChunks(); 
+  unique_lock<mutex> lock(mMutex); 
+  mDone.wait(lock, [&] { return mBusy == 0; }); 
+  mRunning = false; 
+}
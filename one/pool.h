@@ -0,0 +1,58 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads, sized to the machine, that split
+// index ranges between them. The calling thread works too, and
+// parallelFor returns once every index has been handled.
+class ThreadPool
+{
+public:
+
+  static ThreadPool &instance(); 
+
+  ~ThreadPool(); 
+
+  // Call body(begin, end) on disjoint chunks covering [0, n), of
+  // at least grain indices each (0 picks a default that suits
+  // cheap per index work).
+  void parallelFor( int n, const std::function<void(int, int)> &body, int grain = 0 ); 
+
+  int size() const { return mWorkers.size() + 1; }
+
+private:
+
+  ThreadPool( int nThreads ); 
+
+  void work(); 
+
+  void runChunks(); 
+
+  std::vector<std::thread> mWorkers; 
+  // set while a job runs. Nested or concurrent calls run serially.
+  std::atomic<bool> mRunning; 
+  std::mutex mMutex; 
+  std::condition_variable mWake, mDone; 
+
+  // the job currently being run
+  const std::function<void(int, int)> *mBody; 
+  int mN, mChunk; 
+  std::atomic<int> mNext; 
+  int mBusy;
+  unsigned mGeneration; 
+  bool mStop; 
+};
+
+// Shorthand for ThreadPool::instance().parallelFor(n, body, grain).
+inline void parallelFor( int n, const std::function<void(int, int)> &body, int grain = 0 )
+{
+  ThreadPool::instance().parallelFor(n, body, grain); 
+}
+
+#endif
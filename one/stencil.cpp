@@ -0,0 +1,108 @@
+#include "stencil.h"
+#include "extra.h"
+#include "pool.h"
+
+using namespace std;
+
+namespace
+{
+  // Accumulates weighted rows of a stencil table into one row
+  // without touching the untouched columns.
+  struct RowBuilder {
+    vector<float> acc; 
+    vector<int> cols; 
+
+    RowBuilder (int n) : acc(n, 0.f) {}
+
+    void add (const StencilTable &t, int row, float w) {
+      for (int k = t.offsets[row]; k < t.offsets[row + 1]; k++) {
+        int j = t.indices[k]; 
+        if (acc[j] == 0.f) 
+          cols.push_back(j); 
+        acc[j] += w * t.weights[k]; 
+      }
+    }
+
+    void emit (StencilTable &t) {
+      for (int j : cols) {
+        t.indices.push_back(j); 
+        t.weights.push_back(acc[j]); 
+        acc[j] = 0.f; 
+      }
+      cols.clear(); 
+      t.offsets.push_back(t.indices.size()); 
+    }
+  };
+}
+
+StencilTable buildLoopStencils (const Mesh &cage, int levels, Mesh &refined)
+{
+  int n = cage.vertices.size(); 
+  refined = cage; 
+
+  // level 0 is the identity
+  StencilTable table; 
+  table.offsets.push_back(0); 
+  for (int i = 0; i < n; i++) {
+    table.indices.push_back(i); 
+    table.weights.push_back(1.f); 
+    table.offsets.push_back(i + 1); 
+  }
+
+  RowBuilder row(n); 
+  for (int l = 0; l < levels; l++) {
+    const HalfEdgeMesh &he = refined.halfEdges; 
+    StencilTable next; 
+    next.offsets.push_back(0); 
+
+    // Same masks as Mesh::loopSubdivide, applied to rows. Even 
+    // vertex v keeps its id and the odd vertex on edge e is V + e.
+    for (auto &u : refined.vertices) {
+      int valence = he.forOneRing(u.id, [] (int) {}); 
+      float BETA = 3.f / ((valence > 3) ? 8.f * valence : 16.f);
+      he.forOneRing(u.id, [&] (int w) { row.add(table, w, BETA); }); 
+      row.add(table, u.id, 1.f - (BETA * valence)); 
+      row.emit(next); 
+    }
+    for (auto &e : refined.edges) {
+      int h = he.edgeHalf[e.id], t = he.twin[h]; 
+      row.add(table, he.opposite(h), 1.f / 8.f); 
+      row.add(table, he.opposite(t), 1.f / 8.f); 
+      row.add(table, he.origin[h], 3.f / 8.f); 
+      row.add(table, he.dest(h), 3.f / 8.f); 
+      row.emit(next); 
+    }
+
+    refined.loopSubdivide(); 
+    table = next; 
+  }
+  return table; 
+}
+
+void evalStencils (const StencilTable &table, 
+    const VertexArrays &control, Mesh &refined)
+{
+  VertexArrays &out = refined.geom; 
+  parallelFor(table.size(), [&] (int begin, int end) {
+    for (int i = begin; i < end; i++) {
+      float x = 0, y = 0, z = 0, nx = 0, ny = 0, nz = 0; 
+      for (int k = table.offsets[i]; k < table.offsets[i + 1]; k++) {
+        int j = table.indices[k]; 
+        float w = table.weights[k]; 
+        x += w * control.x[j]; 
+        y += w * control.y[j]; 
+        z += w * control.z[j]; 
+        nx += w * control.nx[j]; 
+        ny += w * control.ny[j]; 
+        nz += w * control.nz[j]; 
+      }
+      out.x[i] = x; 
+      out.y[i] = y; 
+      out.z[i] = z; 
+      out.nx[i] = nx; 
+      out.ny[i] = ny; 
+      out.nz[i] = nz; 
+    }
+    out.normalize(begin, end); 
+  }); 
+}
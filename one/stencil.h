@@ -0,0 +1,30 @@
+#ifndef STENCIL_H
+#define STENCIL_H
+
+#include "mesh.h"
+
+// N levels of Loop refinement factored into a sparse matrix: row i
+// holds the weights with which the control points of the cage add
+// up to vertex i of the refined mesh. Once built, new positions of
+// the cage are refined with a single sparse matrix-vector product
+// and none of the topology work.
+struct StencilTable {
+  vector<int> offsets;   // row i spans [offsets[i], offsets[i + 1])
+  vector<int> indices;   // control point of each entry
+  vector<float> weights; // weight of each entry
+
+  int size () const { return (int) offsets.size() - 1; }
+};
+
+// Refine `cage` `levels` times into `refined` and record the
+// stencils of every refined vertex in terms of the cage's vertices.
+StencilTable buildLoopStencils (const Mesh &cage, int levels, Mesh &refined); 
+
+// Recompute the geometry of `refined` from new control points, the
+// rows split over the thread pool. Normals go through the same
+// weights and are normalized once at the end rather than after
+// every level.
+void evalStencils (const StencilTable &table, 
+    const VertexArrays &control, Mesh &refined); 
+
+#endif
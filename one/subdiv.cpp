@@ -5,8 +5,12 @@
 #include <cmath>
 #include <iostream>
 #include <cstdlib>
+#include <cstdio>
 #include <fstream>
 #include <vector>
+#include <string>
+#include <chrono>
+#include <sys/resource.h>
 
 #include <GL/glut.h>
 #include <vecmath.h>
@@ -17,6 +21,7 @@
 #include "extra.h"
 #include "camera.h"
 #include "mesh.h"
+#include "stencil.h"
 
 using namespace std;
 
@@ -48,6 +53,15 @@ namespace
   // given by the files).
   Mesh mesh;
 
+  // Command line. Giving --levels or --out runs without a window.
+  const char *gObjFile = 0; 
+  const char *gOutFile = 0; 
+  int gLevels = -1; 
+  bool gBinary = false; 
+  bool gStream = false; 
+  bool gPatches = false; 
+  bool gStencils = false; 
+
   // Declarations of functions whose implementations occur later.
   void arcballRotation(int endX, int endY);
   void keyboardFunc( unsigned char key, int x, int y);
@@ -59,6 +73,8 @@ namespace
   void initRendering();
   void loadObjects(int argc, char *argv[]);
   void makeDisplayLists();
+  void parseArgs(int argc, char *argv[]);
+  void runHeadless();
 
   // This function is called whenever a "Normal" key press is
   // received.
@@ -83,6 +99,16 @@ namespace
       case 'S':
         mesh.loopSubdivide();
         break;
+      case 'l':
+      case 'L':
+        mesh.limitProject();
+        break;
+      case 'a':
+      case 'A':
+        // refine where the normals turn by more than ~10 degrees
+        if (mesh.adaptiveSubdivide(0.17f) < 0)
+          cerr << "adaptive subdivision failed, mesh left as it was" << endl;
+        break;
       case 'p':
       case 'P':
         break;            
@@ -233,21 +259,26 @@ namespace
     glMaterialfv(GL_FRONT_AND_BACK, GL_SHININESS, shininess);
   }
 
+  void usage(const char *prog)
+  {
+    cerr<< "usage: " << prog << " OBJFILE [--levels N] [--out FILE] [--binary] [--stream] [--patches] [--stencils] [--validate off|cheap|full]" << endl;
+  }
+
   // Load in objects from standard input into the global variables: 
   // gCtrlPoints, gCurves, gCurveNames, gSurfaces, gSurfaceNames.  If
   // loading fails, this will exit the program.
   void loadObjects(int argc, char *argv[])
   {
-    if (argc < 2)
+    if (!gObjFile)
     {
-      cerr<< "usage: " << argv[0] << " OBJFILE " << endl;
+      usage(argv[0]);
       exit(0);
     }
 
-    ifstream in(argv[1]);
+    ifstream in(gObjFile);
     if (!in)
     {
-      cerr<< argv[1] << " not found\a" << endl;
+      cerr<< gObjFile << " not found\a" << endl;
       exit(0);
     }
 
@@ -267,6 +298,146 @@ namespace
 
   }
 
+  void parseArgs(int argc, char *argv[])
+  {
+    for (int i = 1; i < argc; i++)
+    {
+      string a = argv[i];
+      if (a == "--levels" && i + 1 < argc)
+        gLevels = atoi(argv[++i]);
+      else if (a == "--out" && i + 1 < argc)
+        gOutFile = argv[++i];
+      else if (a == "--binary")
+        gBinary = true;
+      else if (a == "--stream")
+        gStream = true;
+      else if (a == "--patches")
+        gPatches = true;
+      else if (a == "--stencils")
+        gStencils = true;
+      else if (a == "--validate" && i + 1 < argc)
+      {
+        string level = argv[++i];
+        if (level == "off")
+          mesh.validation = VALIDATE_OFF;
+        else if (level == "cheap")
+          mesh.validation = VALIDATE_CHEAP;
+        else if (level == "full")
+          mesh.validation = VALIDATE_FULL;
+        else
+        {
+          cerr << "unknown validation level " << level << endl;
+          usage(argv[0]);
+          exit(1);
+        }
+      }
+      else if (!gObjFile)
+        gObjFile = argv[i];
+      else
+        cerr << "ignoring argument " << a << endl;
+    }
+  }
+
+  // Peak resident set size of the process so far, in KB.
+  long peakMemory()
+  {
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+  }
+
+  // Subdivide gLevels times and optionally write the result,
+  // printing one line of timings and counts per level. With 
+  // --stream the last level is never built, it is computed while
+  // being written.
+  void runHeadless()
+  {
+    typedef chrono::steady_clock Clock;
+    auto ms = [] (Clock::time_point a, Clock::time_point b) {
+      return chrono::duration<double, milli>(b - a).count();
+    };
+    printf("%5s %10s %10s %10s %10s %10s\n",
+        "level", "vertices", "edges", "faces", "ms", "peak KB");
+    printf("%5d %10zu %10zu %10zu %10s %10ld\n", 0, mesh.vertices.size(),
+        mesh.edges.size(), mesh.faces.size(), "-", peakMemory());
+    double total = 0;
+    bool stream = gStream && gOutFile && gLevels > 0;
+    int levels = gLevels - (stream ? 1 : 0);
+    if (gPatches && levels > 0)
+    {
+      // all levels at once on the grids of the coarse faces
+      auto t0 = Clock::now();
+      mesh.patchSubdivide(levels);
+      total = ms(t0, Clock::now());
+      printf("%5d %10zu %10zu %10zu %10.2f %10ld\n", levels, mesh.vertices.size(),
+          mesh.edges.size(), mesh.faces.size(), total, peakMemory());
+      levels = 0;
+    }
+    if (gStencils && levels > 0)
+    {
+      // Factor all levels into a stencil table and check, on a moved
+      // copy of the cage, that re-evaluating the table gives what
+      // refining the moved cage from scratch does. The result kept
+      // is the table evaluated on the cage as read.
+      Mesh refined, moved = mesh;
+      auto t0 = Clock::now();
+      StencilTable table = buildLoopStencils(mesh, levels, refined);
+      printf("stencils: %d rows, %zu weights, built in %.2f ms\n", table.size(),
+          table.weights.size(), ms(t0, Clock::now()));
+      VertexArrays &g = moved.geom;
+      for (int v = 0; v < g.size(); v++)
+      {
+        float d = 0.05f * sinf(v);
+        g.x[v] += d * g.nx[v];
+        g.y[v] += d * g.ny[v];
+        g.z[v] += d * g.nz[v];
+      }
+      Mesh check = refined;
+      t0 = Clock::now();
+      evalStencils(table, moved.geom, check);
+      double eval = ms(t0, Clock::now());
+      t0 = Clock::now();
+      for (int l = 0; l < levels; l++)
+        moved.loopSubdivide();
+      double loop = ms(t0, Clock::now());
+      float err = 0;
+      for (int v = 0; v < check.geom.size(); v++)
+        err = max(err, (project(check.geom.position(v)) - project(moved.geom.position(v))).abs());
+      printf("stencils: evaluated in %.2f ms, loopSubdivide %.2f ms, largest difference %g\n",
+          eval, loop, err);
+      evalStencils(table, mesh.geom, refined);
+      mesh = refined;
+      total = eval;
+      levels = 0;
+    }
+    for (int l = 1; l <= levels; l++)
+    {
+      auto t0 = Clock::now();
+      mesh.loopSubdivide();
+      double t = ms(t0, Clock::now());
+      total += t;
+      printf("%5d %10zu %10zu %10zu %10.2f %10ld\n", l, mesh.vertices.size(),
+          mesh.edges.size(), mesh.faces.size(), t, peakMemory());
+    }
+    printf("subdivision %.2f ms\n", total);
+    if (gOutFile)
+    {
+      auto t0 = Clock::now();
+      ofstream out(gOutFile, gBinary ? ios::binary : ios::out);
+      if (!out)
+      {
+        cerr << "can't write " << gOutFile << endl;
+        exit(-1);
+      }
+      if (stream)
+        mesh.writeSubdivided(out, gBinary);
+      else
+        mesh.write(out, gBinary);
+      out.close();
+      printf("wrote %s in %.2f ms, peak %ld KB\n", gOutFile, ms(t0, Clock::now()), peakMemory());
+    }
+  }
+
   void makeDisplayLists()
   {
     gAxisList = glGenLists(1);
@@ -307,8 +478,15 @@ namespace
 int main( int argc, char* argv[] )
 {
   // Load in from standard input
+  parseArgs(argc, argv);
   loadObjects(argc, argv);
 
+  if (gLevels >= 0 || gOutFile)
+  {
+    runHeadless();
+    return 0;
+  }
+
   glutInit(&argc,argv);
 
   // We're going to animate it, so double buffer 
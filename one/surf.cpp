@@ -1,6 +1,10 @@
 #include "surf.h"
+#include <algorithm>
+#include <string>
 #include <vector>
 #include "extra.h"
+#include "pool.h"
+#include "write.h"
 using namespace std;
 
 namespace
@@ -20,36 +24,66 @@ namespace
   }
 }
 
-struct IdPair {
-  int i, j, n, m; 
-  IdPair (int i, int j, int n, int m) : i(i % n), j(j % m), n(n), m(m) {}
-  int to1D () { return i * m + j; }
-}; 
+namespace
+{
+  bool stripSurfaces = false; 
+}
+
+void setStripSurfaces(bool on)
+{
+  stripSurfaces = on; 
+}
 
+// Index buffers of an n by m grid of vertices, vertex i * m + j
+// being point i of the profile at sweep sample j. j always wraps
+// around, i only for closed grids. Each quad is two triangles, or
+// with strips on, each row of quads is one strip of 2(m+1) indices.
 void makeFaces (int n, int m, Surface &surface, bool closed=false) {
-  vector<vector<IdPair> > f; 
-  for (int i = 0; i < n; i++) 
-    for (int j = 0; j < m; j++) 
-      if (closed || i + 1 < n) {
-        f.push_back(vector<IdPair>({
-          IdPair(i    , j    , n, m), 
-          IdPair(i + 1, j    , n, m),
-          IdPair(i    , j + 1, n, m)
-        })); 
-        f.push_back(vector<IdPair>({
-          IdPair(i    , j + 1, n, m), 
-          IdPair(i + 1, j    , n, m), 
-          IdPair(i + 1, j + 1, n, m)
-        })); 
+  int rows = closed ? n : n - 1; 
+  if (stripSurfaces) {
+    surface.strips.resize(rows * (2 * m + 3)); 
+    unsigned *s = surface.strips.data(); 
+    for (int i = 0; i < rows; i++) {
+      int i1 = (i + 1) % n; 
+      for (int j = 0; j <= m; j++) {
+        *s++ = i * m + j % m; 
+        *s++ = i1 * m + j % m; 
       }
-  for (auto &tup: f) 
-    surface.VF.emplace_back(
-      tup[0].to1D(), 
-      tup[1].to1D(), 
-      tup[2].to1D()
-    ); 
+      *s++ = STRIP_RESTART; 
+    }
+    return; 
+  }
+  surface.VF.resize(2 * rows * m); 
+  Tup3u *f = surface.VF.data(); 
+  for (int i = 0; i < rows; i++) {
+    int i1 = (i + 1) % n; 
+    for (int j = 0; j < m; j++) {
+      int j1 = (j + 1) % m; 
+      *f++ = Tup3u(i * m + j, i1 * m + j, i * m + j1); 
+      *f++ = Tup3u(i * m + j1, i1 * m + j, i1 * m + j1); 
+    }
+  }
 }
 
+void stripTriangles(const Surface &surface, vector<Tup3u> &VF)
+{
+  // Triangle k of a strip is (k, k+1, k+2), with the first two
+  // swapped when k is odd so every triangle keeps its winding.
+  VF.clear(); 
+  int k = 0; 
+  const vector<unsigned> &s = surface.strips; 
+  for (size_t i = 0; i + 2 < s.size(); i++, k++) {
+    if (s[i + 2] == STRIP_RESTART) {
+      i += 2; 
+      k = -1; 
+      continue; 
+    }
+    if (k % 2 == 0) 
+      VF.push_back(Tup3u(s[i], s[i + 1], s[i + 2])); 
+    else
+      VF.push_back(Tup3u(s[i + 1], s[i], s[i + 2])); 
+  }
+}
 
 Surface makeSurfRev(const Curve &profile, unsigned steps)
 {
@@ -60,30 +94,22 @@ Surface makeSurfRev(const Curve &profile, unsigned steps)
     cerr << "surfRev profile curve must be flat on xy plane." << endl;
     exit(0);
   }
-  Curve profile_ = profile;
-  for (auto &p : profile_) 
-    p.N.negate(); 
-  int n = profile_.size(), m = steps;
+  // Vertex i * m + j is profile point i turned by theta * j. Each
+  // turn is built from its own angle, not by composing the previous
+  // ones, so the last ring is as exact as the first.
+  int n = profile.size(), m = steps;
   float theta = 2.f * M_PI / (m + 0.f); 
-  vector<Curve> S; 
-  for (int i = 0; i < m; i++) {
-    S.emplace_back(); 
-    for (auto p : profile_) 
-      S.back().push_back(p); 
-    Matrix3f roty = Matrix3f::rotateY(theta);
-    for (auto &p : profile_) { 
-      p.V = roty * p.V; 
-      p.T = roty * p.T; 
-      p.B = roty * p.B; 
-      p.N = roty * p.N; 
-      p.N.normalize();
+  surface.VV.resize(n * m); 
+  surface.VN.resize(n * m); 
+  parallelFor(m, [&](int begin, int end) {
+    for (int j = begin; j < end; j++) {
+      Matrix3f roty = Matrix3f::rotateY(theta * j); 
+      for (int i = 0; i < n; i++) {
+        surface.VV[i * m + j] = expand(roty * profile[i].V); 
+        surface.VN[i * m + j] = expand(-(roty * profile[i].N).normalized()); 
+      }
     }
-  }
- for (int i = 0; i < n; i++) 
-   for (int j = 0; j < m; j++) {
-     surface.VV.push_back(expand(S[j][i].V)); 
-     surface.VN.push_back(expand(S[j][i].N)); 
-   }
+  }, 1); 
   makeFaces(n, m, surface); 
   return surface;
 }
@@ -98,25 +124,21 @@ Surface makeGenCyl(const Curve &profile, const Curve &sweep )
     exit(0);
   }
   
-  Curve profile_ = profile;
-  for (auto &p : profile_) 
-    p.N.negate(); 
-  int n = profile_.size(), m = sweep.size();
-  vector<vector<Vector3f> > VV, VN; 
-  for (auto &sp : sweep) {
-    VV.emplace_back(); 
-    VN.emplace_back(); 
-    Matrix3f B(sp.N, sp.B, sp.T); 
-    for (auto &pp : profile_) { 
-      VV.back().push_back(sp.V + B * pp.V); 
-      VN.back().push_back((B * pp.N).normalized()); 
+  // Vertex i * m + j is profile point i placed in the frame of sweep
+  // point j.
+  int n = profile.size(), m = sweep.size();
+  surface.VV.resize(n * m); 
+  surface.VN.resize(n * m); 
+  parallelFor(m, [&](int begin, int end) {
+    for (int j = begin; j < end; j++) {
+      const CurvePoint &sp = sweep[j]; 
+      Matrix3f B(sp.N, sp.B, sp.T); 
+      for (int i = 0; i < n; i++) {
+        surface.VV[i * m + j] = expand(sp.V + B * profile[i].V); 
+        surface.VN[i * m + j] = expand(-(B * profile[i].N).normalized()); 
+      }
     }
-  }
- for (int i = 0; i < n; i++) 
-   for (int j = 0; j < m; j++) {
-     surface.VV.push_back(expand(VV[j][i])); 
-     surface.VN.push_back(expand(VN[j][i])); 
-   }
+  }, 1); 
   makeFaces(n, m, surface); 
 
   return surface;
@@ -161,6 +183,28 @@ void drawSurface(const Surface &surface, bool shaded)
   }
   glEnd();
 
+  // Immediate mode has no primitive restart, so each strip is its
+  // own glBegin/glEnd.
+  bool open = false;
+  for (unsigned i=0; i<surface.strips.size(); i++)
+  {
+    unsigned v = surface.strips[i];
+    if (v == STRIP_RESTART)
+    {
+      if (open)
+        glEnd();
+      open = false;
+      continue;
+    }
+    if (!open)
+      glBegin(GL_TRIANGLE_STRIP);
+    open = true;
+    glNormal(surface.VN[v]);
+    glVertex(surface.VV[v]);
+  }
+  if (open)
+    glEnd();
+
   glPopAttrib();
 }
 
@@ -184,31 +228,42 @@ void drawNormals(const Surface &surface, float len)
   glPopAttrib();
 }
 
-void outputObjFile(ostream &out, const Surface &surface)
+namespace
 {
-
-  for (unsigned i=0; i<surface.VV.size(); i++)
-    out << "v  "
-      << surface.VV[i][0] << " "
-      << surface.VV[i][1] << " "
-      << surface.VV[i][2] << endl;
-
-  for (unsigned i=0; i<surface.VN.size(); i++)
-    out << "vn "
-      << surface.VN[i][0] << " "
-      << surface.VN[i][1] << " "
-      << surface.VN[i][2] << endl;
-
-  out << "vt  0 0 0" << endl;
-
-  for (unsigned i=0; i<surface.VF.size(); i++)
+  // The faces of surface as triangles, expanding its strips if it
+  // has them.
+  const vector<Tup3u> &triangles(const Surface &surface, vector<Tup3u> &stripFaces)
   {
-    out << "f  ";
-    for (unsigned j=0; j<3; j++)
-    {
-      unsigned a = surface.VF[i][j]+1;
-      out << a << "/" << "1" << "/" << a << " ";
-    }
-    out << endl;
+    if (surface.strips.empty()) 
+      return surface.VF; 
+    stripTriangles(surface, stripFaces); 
+    return stripFaces; 
   }
 }
+
+void outputObjFile(ostream &out, const Surface &surface)
+{
+  writeChunked(out, surface.VV.size(), [&](int i, string &s) {
+    const Vector4f &v = surface.VV[i], &n = surface.VN[i]; 
+    putObjVertex(s, v[0], v[1], v[2], n[0], n[1], n[2]); 
+  }); 
+  vector<Tup3u> stripFaces; 
+  const vector<Tup3u> &VF = triangles(surface, stripFaces); 
+  writeChunked(out, VF.size(), [&](int i, string &s) {
+    putObjFace(s, VF[i][0], VF[i][1], VF[i][2]); 
+  }); 
+}
+
+void outputPlyFile(ostream &out, const Surface &surface)
+{
+  vector<Tup3u> stripFaces; 
+  const vector<Tup3u> &VF = triangles(surface, stripFaces); 
+  writePlyHeader(out, surface.VV.size(), VF.size()); 
+  writeChunked(out, surface.VV.size(), [&](int i, string &s) {
+    const Vector4f &v = surface.VV[i], &n = surface.VN[i]; 
+    putPlyVertex(s, v[0], v[1], v[2], n[0], n[1], n[2]); 
+  }); 
+  writeChunked(out, VF.size(), [&](int i, string &s) {
+    putPlyFace(s, VF[i][0], VF[i][1], VF[i][2]); 
+  }); 
+}
@@ -14,13 +14,21 @@ typedef tuple< unsigned, 3 > Tup3u;
 // faces.  VV[i] is the position of vertex i, and VN[i] is the normal
 // of vertex i.  A face is a triple i,j,k corresponding to a triangle
 // with (vertex i, normal i), (vertex j, normal j), ...
+//
+// With strips on (setStripSurfaces), the faces are instead given as
+// triangle strips: runs of vertex indices in strips, each ended by
+// STRIP_RESTART, and VF is left empty.
 struct Surface
 {
   std::vector< Vector4f > VV;
   std::vector< Vector4f > VN;
   std::vector< Tup3u > VF;
+  std::vector< unsigned > strips;
 };
 
+// Ends a strip in Surface::strips, like a primitive restart index.
+const unsigned STRIP_RESTART = 0xFFFFFFFFu;
+
 // This draws the surface.  Draws the surfaces with smooth shading if
 // shaded==true, otherwise, draws a wireframe.
 void drawSurface( const Surface& surface, bool shaded );
@@ -35,7 +43,18 @@ Surface makeSurfRev( const Curve& profile, unsigned steps );
 Surface makeGenCyl( const Curve& profile,
     const Curve& sweep );
 
+// When on, swept surfaces are built as one triangle strip per row of
+// quads, about a third of the indices of separate triangles.
+void setStripSurfaces( bool on );
+
+// The triangles of the strips of surface, in VF.
+void stripTriangles( const Surface& surface, std::vector< Tup3u >& VF );
+
+// Write surface as an OBJ file, or as a binary PLY file with a
+// position and normal per vertex. Lines are formatted in chunks on
+// the thread pool, floats in their shortest exact form.
 void outputObjFile( std::ostream& out, const Surface& surface );
+void outputPlyFile( std::ostream& out, const Surface& surface );
 
 #endif
 
@@ -0,0 +1,67 @@
+#include "mesh.h"
+#include "pool.h"
+#include "write.h"
+
+using namespace std;
+
+namespace
+{
+  // write vertices [0, n) of g
+  void writeVertices (ostream &out, bool binary, const VertexArrays &g, int n) {
+    writeChunked(out, n, [&] (int i, string &s) {
+      if (binary) 
+        putPlyVertex(s, g.x[i], g.y[i], g.z[i], g.nx[i], g.ny[i], g.nz[i]); 
+      else 
+        putObjVertex(s, g.x[i], g.y[i], g.z[i], g.nx[i], g.ny[i], g.nz[i]); 
+    }); 
+  }
+
+  void putFace (string &s, bool binary, int a, int b, int c) {
+    if (binary) 
+      putPlyFace(s, a, b, c); 
+    else 
+      putObjFace(s, a, b, c); 
+  }
+}
+
+void Mesh::write (ostream &out, bool binary) const {
+  if (binary) 
+    writePlyHeader(out, geom.size(), faces.size()); 
+  writeVertices(out, binary, geom, geom.size()); 
+  writeChunked(out, faces.size(), [&] (int i, string &s) {
+    putFace(s, binary, faces[i].vs[0], faces[i].vs[1], faces[i].vs[2]); 
+  }); 
+}
+
+void Mesh::writeSubdivided (ostream &out, bool binary) const {
+  // Same numbering as loopSubdivide: even vertex v keeps its id,
+  // the odd vertex on edge e is V + e, and face f splits into its
+  // three corners and the middle. Children keep the winding of 
+  // their parent.
+  int nv = vertices.size(), ne = edges.size(); 
+  if (binary) 
+    writePlyHeader(out, nv + ne, 4 * faces.size()); 
+  // refined vertices are computed a writer chunk at a time
+  VertexArrays chunk; 
+  chunk.resize(WRITE_CHUNK); 
+  for (int begin = 0; begin < nv + ne; begin += WRITE_CHUNK) {
+    int n = min(WRITE_CHUNK, nv + ne - begin); 
+    parallelFor(n, [&] (int b, int e) {
+      for (int i = b; i < e; i++) {
+        int u = begin + i; 
+        if (u < nv) 
+          _evenGeometry(u, chunk, i); 
+        else 
+          _oddGeometry(u - nv, chunk, i); 
+      }
+      chunk.normalize(b, e); 
+    }); 
+    writeVertices(out, binary, chunk, n); 
+  }
+  writeChunked(out, faces.size(), [&] (int k, string &s) {
+    const Face &f = faces[k]; 
+    for (int i = 0; i < 3; i++) 
+      putFace(s, binary, f.vs[i], nv + f.es[i], nv + f.es[(i + 2) % 3]); 
+    putFace(s, binary, nv + f.es[0], nv + f.es[1], nv + f.es[2]); 
+  }); 
+}
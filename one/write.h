@@ -0,0 +1,119 @@
+#ifndef WRITE_H
+#define WRITE_H
+
+#include <algorithm>
+#include <charconv>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "pool.h"
+
+// Helpers shared by the OBJ and PLY writers of surfaces (surf.cpp)
+// and meshes (write.cpp). Records are formatted into strings on the
+// thread pool and written out in order with one write per chunk.
+
+// records formatted per task by writeChunked
+const int WRITE_CHUNK = 1 << 14; 
+
+// Calls format(i, buffer) for i in [0, n), chunk by chunk on the
+// pool, and writes the buffers out in order. Only a few chunks per
+// thread are held at once, so memory does not grow with n.
+template <class Format>
+void writeChunked( std::ostream& out, int n, const Format& format )
+{
+  int batch = 4 * ThreadPool::instance().size(); 
+  std::vector<std::string> buffers(batch); 
+  int chunks = (n + WRITE_CHUNK - 1) / WRITE_CHUNK; 
+  for (int c0 = 0; c0 < chunks; c0 += batch) {
+    int nb = std::min(batch, chunks - c0); 
+    parallelFor(nb, [&](int b, int e) {
+      for (int k = b; k < e; k++) {
+        std::string &s = buffers[k]; 
+        s.clear(); 
+        int begin = (c0 + k) * WRITE_CHUNK; 
+        int end = std::min(n, begin + WRITE_CHUNK); 
+        for (int i = begin; i < end; i++)
+          format(i, s); 
+      }
+    }, 1); 
+    for (int k = 0; k < nb; k++)
+      out.write(buffers[k].data(), buffers[k].size()); 
+  }
+}
+
+// Appends the shortest text that reads back as exactly x.
+template <class T>
+void put( std::string& s, T x )
+{
+  char buf[32]; 
+  s.append(buf, std::to_chars(buf, buf + sizeof(buf), x).ptr); 
+}
+
+template <class T>
+void putBytes( std::string& s, const T& x )
+{
+  s.append((const char *) &x, sizeof(x)); 
+}
+
+// "v x y z" and "vn nx ny nz" lines of one OBJ vertex.
+inline void putObjVertex( std::string& s, float x, float y, float z,
+    float nx, float ny, float nz )
+{
+  const char *tag[2] = { "v ", "vn " }; 
+  float v[2][3] = { { x, y, z }, { nx, ny, nz } }; 
+  for (int k = 0; k < 2; k++) {
+    s += tag[k]; 
+    put(s, v[k][0]); 
+    s += ' '; 
+    put(s, v[k][1]); 
+    s += ' '; 
+    put(s, v[k][2]); 
+    s += '\n'; 
+  }
+}
+
+// "f a//a b//b c//c" with the 0 based ids a, b and c.
+inline void putObjFace( std::string& s, int a, int b, int c )
+{
+  int vs[3] = { a, b, c }; 
+  s += 'f'; 
+  for (int j = 0; j < 3; j++) {
+    s += ' '; 
+    put(s, vs[j] + 1); 
+    s += "//"; 
+    put(s, vs[j] + 1); 
+  }
+  s += '\n'; 
+}
+
+// Binary little endian PLY with a position and a normal per vertex
+// and triangles as faces. The records assume a little endian host,
+// like everything we build on.
+inline void writePlyHeader( std::ostream& out, int nv, int nf )
+{
+  std::string s = "ply\nformat binary_little_endian 1.0\nelement vertex "; 
+  put(s, nv); 
+  s += "\nproperty float x\nproperty float y\nproperty float z\n"
+       "property float nx\nproperty float ny\nproperty float nz\n"
+       "element face "; 
+  put(s, nf); 
+  s += "\nproperty list uchar int vertex_indices\nend_header\n"; 
+  out.write(s.data(), s.size()); 
+}
+
+inline void putPlyVertex( std::string& s, float x, float y, float z,
+    float nx, float ny, float nz )
+{
+  float v[6] = { x, y, z, nx, ny, nz }; 
+  putBytes(s, v); 
+}
+
+inline void putPlyFace( std::string& s, int a, int b, int c )
+{
+  unsigned char n = 3; 
+  int vs[3] = { a, b, c }; 
+  putBytes(s, n); 
+  putBytes(s, vs); 
+}
+
+#endif
@@ -1,6 +1,9 @@
 #include <GL/glut.h>
 #include <cmath>
+#include <cstdlib>
+#include <string>
 #include <iostream>
+#include <fstream>
 #include <vector>
 #include <vecmath.h>
 #include "mesh.h" 
@@ -16,6 +19,7 @@ const int SPIN_TIME = 1;
 int colorId = 0, xCount = 0, yCount = 0; 
 bool rotateCam = false, simplify = false;
 float theta = 0;
+string outFile = "simplified.obj"; 
 
 Mesh mesh; 
 GarlandHeckbert *algo; 
@@ -34,6 +38,13 @@ void keyboardFunc( unsigned char key, int x, int y )
     case 's': 
       simplify = !simplify; 
       break; 
+    case 'w': 
+      {
+        ofstream out(outFile.c_str()); 
+        mesh.write(out); 
+        cerr << "wrote " << outFile << endl;
+      }
+      break; 
     case 'c':
       // add code to change color here
       colorId = (colorId + 1) % 4;
@@ -170,7 +181,22 @@ void reshapeFunc(int w, int h)
 // Set up OpenGL, define the callbacks and start the main loop
 int main( int argc, char** argv )
 {
-  mesh.read(); 
+  float weldEps = 0, ratio = 0.5f; 
+  int partitions = 0; 
+  for (int i = 1; i < argc; i++) 
+    if (string(argv[i]) == "-w") {
+      float eps = (i + 1 < argc) ? atof(argv[i + 1]) : 0; 
+      weldEps = (eps > 0) ? eps : 1e-5f; 
+    } else if (string(argv[i]) == "-o" && i + 1 < argc) {
+      outFile = argv[i + 1]; 
+    } else if (string(argv[i]) == "-p" && i + 1 < argc) {
+      partitions = atoi(argv[i + 1]); 
+    } else if (string(argv[i]) == "-r" && i + 1 < argc) {
+      ratio = atof(argv[i + 1]); 
+    }
+  mesh.read(weldEps); 
+  if (partitions > 0) 
+    partitionedSimplify(mesh, partitions, ratio); 
   algo = new GarlandHeckbert(mesh); 
   glutInit(&argc,argv);
 
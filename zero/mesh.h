@@ -1,6 +1,7 @@
 #include <vecmath.h> 
 #include <set> 
 #include <vector> 
+#include <iostream> 
 
 using namespace std;
 
@@ -28,9 +29,18 @@ struct Mesh {
     return (faces.size() - invalidFaces.size()) == 0;
   }
 
-  void read(); // read mesh from stdin
+  // read mesh from stdin, optionally welding vertices that
+  // fall in the same cell of size weldEps.
+  void read(float weldEps = 0);
 
   void draw(); // draw mesh in opengl
 
+  // drop the invalid faces and vertices and renumber the rest.
+  void compact(); 
+
+  // write the remaining faces as an OBJ, ordered for 
+  // vertex cache reuse.
+  void write(ostream &out); 
+
 }; 
 
@@ -0,0 +1,130 @@
+#include <cmath>
+#include <deque>
+#include <algorithm>
+#include "optimize.h"
+
+using namespace std;
+
+float acmr (const vector<int> &indices, int cacheSize) {
+  if (indices.empty()) 
+    return 0; 
+  deque<int> cache; 
+  int misses = 0;
+  for (int v : indices) 
+    if (find(cache.begin(), cache.end(), v) == cache.end()) {
+      misses++; 
+      cache.push_back(v); 
+      if ((int) cache.size() > cacheSize) 
+        cache.pop_front(); 
+    }
+  return misses / (indices.size() / 3.f); 
+}
+
+float vertexScore (int cachePos, int remaining) {
+  // Scoring function from Tom Forsyth's "Linear-Speed Vertex Cache
+  // Optimisation". The three most recent vertices get a flat score
+  // so that strips aren't favoured over fans.
+  if (remaining == 0) 
+    return -1; 
+  float score = 0; 
+  if (cachePos >= 0) {
+    if (cachePos < 3) 
+      score = 0.75f; 
+    else 
+      score = pow(1.f - (cachePos - 3) / (CACHE_SIZE - 3.f), 1.5f); 
+  }
+  // boost vertices with few triangles left so that they get 
+  // finished off instead of lingering in the cache.
+  return score + 2.f / sqrt((float) remaining); 
+}
+
+void optimizeVertexCache (vector<int> &indices, int nVertices) {
+  int nt = indices.size() / 3; 
+  // triangles adjacent to each vertex, packed.
+  vector<int> offset(nVertices + 1, 0), remaining(nVertices, 0); 
+  for (int v : indices) 
+    offset[v + 1]++; 
+  for (int i = 0; i < nVertices; i++) 
+    offset[i + 1] += offset[i]; 
+  vector<int> adj(indices.size()); 
+  for (int t = 0; t < nt; t++) 
+    for (int k = 0; k < 3; k++) {
+      int v = indices[3 * t + k]; 
+      adj[offset[v] + remaining[v]++] = t; 
+    }
+
+  vector<int> cachePos(nVertices, -1); 
+  vector<float> vScore(nVertices), tScore(nt, 0); 
+  vector<bool> added(nt, false); 
+  for (int i = 0; i < nVertices; i++) 
+    vScore[i] = vertexScore(-1, remaining[i]); 
+  for (int t = 0; t < nt; t++) 
+    for (int k = 0; k < 3; k++) 
+      tScore[t] += vScore[indices[3 * t + k]]; 
+
+  vector<int> out, cache; 
+  out.reserve(indices.size()); 
+  int best = -1, cursor = 0; 
+  for (int emitted = 0; emitted < nt; emitted++) {
+    if (best < 0) {
+      // nothing in the cache is worth drawing, fall back to the 
+      // first triangle not drawn yet. The cursor only moves forward,
+      // so this costs O(1) amortized even on meshes made of many
+      // separate pieces.
+      for (; cursor < nt && added[cursor]; cursor++); 
+      best = cursor; 
+    }
+    added[best] = true; 
+    // push the triangle's vertices to the front of the cache. 
+    vector<int> next; 
+    for (int k = 0; k < 3; k++) {
+      int v = indices[3 * best + k]; 
+      out.push_back(v); 
+      next.push_back(v); 
+      int *a = &adj[offset[v]]; 
+      int *e = remove(a, a + remaining[v], best); 
+      remaining[v] = e - a; 
+    }
+    for (int v : cache) 
+      if (find(next.begin(), next.end(), v) == next.end()) 
+        next.push_back(v); 
+    // vertices that fall out of the cache need their score updated too.
+    for (int i = 0; i < (int) next.size(); i++) 
+      cachePos[next[i]] = (i < CACHE_SIZE) ? i : -1; 
+    best = -1; 
+    float bestScore = -1; 
+    for (int v : next) {
+      float s = vertexScore(cachePos[v], remaining[v]); 
+      float ds = s - vScore[v]; 
+      vScore[v] = s; 
+      for (int i = 0; i < remaining[v]; i++) 
+        tScore[adj[offset[v] + i]] += ds; 
+    }
+    if ((int) next.size() > CACHE_SIZE) 
+      next.resize(CACHE_SIZE); 
+    cache = next; 
+    for (int v : cache) 
+      for (int i = 0; i < remaining[v]; i++) {
+        int t = adj[offset[v] + i]; 
+        if (tScore[t] > bestScore) {
+          bestScore = tScore[t]; 
+          best = t; 
+        }
+      }
+  }
+  indices = out; 
+}
+
+void optimizeVertexFetch (vector<int> &indices, vector<int> &order) {
+  vector<int> remap; 
+  order.clear(); 
+  for (int &v : indices) {
+    if (v >= (int) remap.size()) 
+      remap.resize(v + 1, -1); 
+    if (remap[v] < 0) {
+      remap[v] = order.size(); 
+      order.push_back(v); 
+    }
+    v = remap[v]; 
+  }
+}
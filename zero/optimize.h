@@ -0,0 +1,19 @@
+#include <vector>
+
+using namespace std;
+
+// Post-transform vertex cache size assumed when scoring and 
+// measuring index buffers. 
+const int CACHE_SIZE = 32; 
+
+// Average cache miss ratio: vertices transformed per triangle when
+// `indices` is drawn through a FIFO cache of `cacheSize` entries. 
+float acmr (const vector<int> &indices, int cacheSize = CACHE_SIZE); 
+
+// Reorder the triangles in `indices` for post-transform cache
+// reuse using Forsyth's linear-speed heuristic. 
+void optimizeVertexCache (vector<int> &indices, int nVertices); 
+
+// Renumber vertices in order of first use so that vertex fetches
+// walk memory forwards. order[i] is the old id of new vertex i. 
+void optimizeVertexFetch (vector<int> &indices, vector<int> &order); 
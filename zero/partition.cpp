@@ -0,0 +1,163 @@
+#include <algorithm>
+#include <map>
+#include <thread>
+#include <iostream>
+#include "mesh.h"
+#include "simplify.h"
+
+using namespace std;
+
+int liveFaces (Mesh &mesh) { 
+  return mesh.faces.size() - mesh.invalidFaces.size(); 
+}
+
+void simplifyTo (GarlandHeckbert &gh, int target) {
+  while (liveFaces(gh.mesh) > target && gh.simplifyStep()); 
+}
+
+void partitionedSimplify (Mesh &mesh, int k, float ratio) {
+  int nf = mesh.faces.size(), nv = mesh.vertices.size(); 
+  int target = ratio * liveFaces(mesh); 
+
+  // Split the faces into k slabs with equal face counts along
+  // the longest axis of the bounding box of face centroids.
+  vector<Vector3f> centroids(nf); 
+  Vector3f lo( 1e30f,  1e30f,  1e30f), hi(-1e30f, -1e30f, -1e30f); 
+  for (int i = 0; i < nf; i++) {
+    for (int vi : mesh.faces[i].cornerIds) 
+      centroids[i] = centroids[i] + proj(mesh.vertices[vi].v) / 3.f; 
+    for (int j = 0; j < 3; j++) {
+      lo[j] = min(lo[j], centroids[i][j]); 
+      hi[j] = max(hi[j], centroids[i][j]); 
+    }
+  }
+  Vector3f extent = hi - lo; 
+  int axis = 0; 
+  for (int j = 1; j < 3; j++) 
+    if (extent[j] > extent[axis]) 
+      axis = j; 
+  vector<int> order; 
+  for (int i = 0; i < nf; i++) 
+    if (mesh.invalidFaces.count(i) == 0) 
+      order.push_back(i); 
+  sort(order.begin(), order.end(), [&] (int a, int b) { 
+    return centroids[a][axis] < centroids[b][axis]; 
+  }); 
+  vector<int> part(nf, -1); 
+  for (int i = 0; i < (int) order.size(); i++) 
+    part[order[i]] = (long long) i * k / order.size(); 
+
+  // Vertices used by faces of more than one part lie on a seam.
+  vector<int> owner(nv, -1); 
+  vector<bool> seam(nv, false); 
+  for (int fi : order) 
+    for (int vi : mesh.faces[fi].cornerIds) {
+      if (owner[vi] >= 0 && owner[vi] != part[fi]) 
+        seam[vi] = true; 
+      owner[vi] = part[fi]; 
+    }
+
+  // Build an independent mesh for each part. global[p][i] is 
+  // the id in `mesh` of vertex i of part p.
+  vector<Mesh> parts(k); 
+  vector<vector<int> > global(k); 
+  vector<int> local(nv), stamp(nv, -1); 
+  for (int p = 0; p < k; p++) {
+    Mesh &sub = parts[p]; 
+    vector<set<int> > fids; 
+    for (int fi : order) {
+      if (part[fi] != p) 
+        continue;
+      vector<int> ids; 
+      for (int vi : mesh.faces[fi].cornerIds) {
+        if (stamp[vi] != p) {
+          stamp[vi] = p; 
+          local[vi] = global[p].size(); 
+          global[p].push_back(vi); 
+          fids.emplace_back(); 
+        }
+        ids.push_back(local[vi]); 
+        fids[local[vi]].insert(sub.faces.size()); 
+      }
+      sub.faces.emplace_back(sub.faces.size(), ids); 
+    }
+    for (int i = 0; i < (int) global[p].size(); i++) {
+      auto &v = mesh.vertices[global[p][i]]; 
+      sub.vertices.emplace_back(i, v.v, v.vn, fids[i]); 
+    }
+  }
+
+  // Simplify the parts in parallel, seams stay where they are.
+  vector<GarlandHeckbert *> algos(k); 
+  vector<thread> workers; 
+  for (int p = 0; p < k; p++) 
+    workers.emplace_back([&, p] () {
+      algos[p] = new GarlandHeckbert(parts[p]); 
+      for (int i = 0; i < (int) global[p].size(); i++) 
+        if (seam[global[p][i]]) 
+          algos[p]->pinned.insert(i); 
+      simplifyTo(*algos[p], ratio * liveFaces(parts[p])); 
+    }); 
+  for (auto &w : workers) 
+    w.join(); 
+
+  // Stitch the parts back together. Seam vertices were never 
+  // contracted so they are shared through their original id. The
+  // quadric of a vertex carries over from its part; a seam vertex
+  // sums the quadrics of the faces around it in every part.
+  Mesh merged; 
+  vector<set<int> > fids; 
+  vector<Vertex *> verts; 
+  vector<Matrix4f> Qs; 
+  vector<bool> onSeam; 
+  map<int, int> seamIds; 
+  for (int p = 0; p < k; p++) {
+    Mesh &sub = parts[p]; 
+    vector<int> ids(sub.vertices.size(), -1); 
+    for (int fi = 0; fi < (int) sub.faces.size(); fi++) {
+      if (sub.invalidFaces.count(fi) > 0) 
+        continue;
+      vector<int> corners; 
+      for (int vi : sub.faces[fi].cornerIds) {
+        if (ids[vi] < 0) {
+          bool s = vi < (int) global[p].size() && seam[global[p][vi]]; 
+          if (s && seamIds.count(global[p][vi]) > 0) {
+            ids[vi] = seamIds[global[p][vi]]; 
+            Qs[ids[vi]] = Qs[ids[vi]] + algos[p]->Qs[vi]; 
+          } else {
+            ids[vi] = verts.size(); 
+            verts.push_back(&sub.vertices[vi]); 
+            fids.emplace_back(); 
+            Qs.push_back(algos[p]->Qs[vi]); 
+            onSeam.push_back(s); 
+            if (s) 
+              seamIds[global[p][vi]] = ids[vi]; 
+          }
+        }
+        corners.push_back(ids[vi]); 
+        fids[ids[vi]].insert(merged.faces.size()); 
+      }
+      merged.faces.emplace_back(merged.faces.size(), corners); 
+    }
+  }
+  for (int i = 0; i < (int) verts.size(); i++) 
+    merged.vertices.emplace_back(i, verts[i]->v, verts[i]->vn, fids[i]); 
+  for (auto algo : algos) 
+    delete algo; 
+  mesh = merged; 
+
+  // Final serial pass with the seams unpinned. The parts are 
+  // already simplified, so only the edges at a seam (and the ones
+  // its contractions create) are candidates.
+  cerr << "partitions simplified to " << liveFaces(mesh) << " faces" << endl;
+  set<pair<int, int> > edges; 
+  for (auto &f : mesh.faces) 
+    for (int i = 0; i < 3; i++) {
+      int a = f.cornerIds[i], b = f.cornerIds[(i + 1) % 3]; 
+      if (onSeam[a] || onSeam[b]) 
+        edges.emplace(min(a, b), max(a, b)); 
+    }
+  GarlandHeckbert seams(mesh, Qs, vector<pair<int, int> >(edges.begin(), edges.end())); 
+  simplifyTo(seams, target); 
+  mesh.compact(); 
+}
@@ -1,12 +1,28 @@
 #include "mesh.h" 
+#include "optimize.h"
 #include <string>
 #include <sstream>
 #include <iostream>
+#include <unordered_map>
+#include <cmath>
 
 using namespace std;
 
 const int MAX_BUFFER_SIZE = 200;
 
+struct CellKey {
+  long long x, y, z; 
+  bool operator == (const CellKey &t) const {
+    return x == t.x && y == t.y && z == t.z; 
+  }
+};
+
+struct CellKeyHash {
+  size_t operator () (const CellKey &k) const {
+    return (size_t) (k.x * 73856093LL) ^ (size_t) (k.y * 19349663LL) ^ (size_t) (k.z * 83492791LL); 
+  }
+};
+
 vector<unsigned> split (string s, string delim) {
   // helper function to split string using delimiter
   size_t pos = 0;
@@ -21,7 +37,31 @@ vector<unsigned> split (string s, string delim) {
   return ids;
 }
 
-void Mesh::read () {
+int weld (vector<Vector4f> &vecv, vector<int> &remap, float eps) {
+  // Merge vertices whose positions quantize to the same cell of
+  // size eps. remap[i] is the new id of the i'th vertex. Returns 
+  // the number of vertices that were merged away.
+  unordered_map<CellKey, int, CellKeyHash> cells; 
+  cells.reserve(vecv.size()); 
+  vector<Vector4f> welded; 
+  remap.resize(vecv.size()); 
+  for (int i = 0; i < (int) vecv.size(); i++) {
+    CellKey k = { 
+      llround(vecv[i][0] / eps), 
+      llround(vecv[i][1] / eps), 
+      llround(vecv[i][2] / eps) 
+    };
+    auto it = cells.emplace(k, (int) welded.size()); 
+    if (it.second) 
+      welded.push_back(vecv[i]); 
+    remap[i] = it.first->second; 
+  }
+  int merged = vecv.size() - welded.size(); 
+  vecv = welded; 
+  return merged; 
+}
+
+void Mesh::read (float weldEps) {
   // load the OBJ file here
   char buffer[MAX_BUFFER_SIZE]; 
   // Read input and store vertices, normals and
@@ -50,22 +90,100 @@ void Mesh::read () {
       }
     }
   }
+  // Optionally weld duplicated positions (eg. along UV seams)
+  // so that they don't show up as boundaries during simplification.
+  vector<int> remap(vecv.size()); 
+  for (int i = 0; i < (int) vecv.size(); i++) 
+    remap[i] = i; 
+  if (weldEps > 0) {
+    int merged = weld(vecv, remap, weldEps); 
+    cerr << "welded " << merged << " vertices" << endl;
+  }
   vector<set<int> > fids(vecv.size()); // list of face ids for each vertex
-  vector<int> vnid(vecv.size()); 
-  for (int j = 0; j < vecf.size(); j++) {
+  vector<Vector3f> vns(vecv.size()); 
+  for (int j = 0; j < (int) vecf.size(); j++) {
     auto &ids = vecf[j]; 
     for (auto &num: ids) num--; 
-    int a = ids[0], c = ids[2];
-    int d = ids[3], f = ids[5];
-    int g = ids[6], i = ids[8];
-    faces.emplace_back(j, vector<int>({a, d, g})); 
-    fids[a].insert(j); 
-    fids[d].insert(j); 
-    fids[g].insert(j); 
-    vnid[a] = c;
-    vnid[d] = f;
-    vnid[g] = i;
+    int a = remap[ids[0]], c = ids[2];
+    int d = remap[ids[3]], f = ids[5];
+    int g = remap[ids[6]], i = ids[8];
+    // welding can collapse a face to a sliver, drop it.
+    if (a == d || d == g || g == a) 
+      continue;
+    int fid = faces.size(); 
+    faces.emplace_back(fid, vector<int>({a, d, g})); 
+    fids[a].insert(fid); 
+    fids[d].insert(fid); 
+    fids[g].insert(fid); 
+    // welded vertices average the normals of their duplicates.
+    vns[a] += Vector3f(vecn[c][0], vecn[c][1], vecn[c][2]);
+    vns[d] += Vector3f(vecn[f][0], vecn[f][1], vecn[f][2]);
+    vns[g] += Vector3f(vecn[i][0], vecn[i][1], vecn[i][2]);
+  }
+  for (int i = 0; i < (int) vecv.size(); i++) {
+    Vector4f vn(0, 0, 0, 1); 
+    if (vns[i].absSquared() > 0) {
+      Vector3f n = vns[i].normalized(); 
+      vn = Vector4f(n.x(), n.y(), n.z(), 1); 
+    }
+    vertices.emplace_back(i, vecv[i], vn, fids[i]); 
+  }
+}
+
+void Mesh::compact () {
+  // Keep the live faces and the vertices they use, renumbered in
+  // order, so that nothing refers to a contracted element.
+  vector<int> remap(vertices.size(), -1); 
+  vector<Vertex> vs; 
+  vector<Face> fs; 
+  for (int i = 0; i < (int) faces.size(); i++) {
+    if (invalidFaces.count(i) > 0) 
+      continue;
+    vector<int> corners; 
+    for (int vi : faces[i].cornerIds) {
+      if (remap[vi] < 0) {
+        remap[vi] = vs.size(); 
+        set<int> none; 
+        vs.emplace_back(remap[vi], vertices[vi].v, vertices[vi].vn, none); 
+      }
+      corners.push_back(remap[vi]); 
+      vs[remap[vi]].faceIds.insert(fs.size()); 
+    }
+    fs.emplace_back(fs.size(), corners); 
+  }
+  vertices.swap(vs); 
+  faces.swap(fs); 
+  invalidFaces.clear(); 
+  invalidVertices.clear(); 
+}
+
+void Mesh::write (ostream &out) {
+  // Gather the faces that survived simplification into an index
+  // buffer, reorder it for the post-transform vertex cache and
+  // renumber the vertices in the order they are first used.
+  vector<int> indices; 
+  for (int i = 0; i < (int) faces.size(); i++) 
+    if (invalidFaces.count(i) == 0) 
+      for (int vi : faces[i].cornerIds) 
+        indices.push_back(vi); 
+  float before = acmr(indices); 
+  optimizeVertexCache(indices, vertices.size()); 
+  vector<int> order; 
+  optimizeVertexFetch(indices, order); 
+  cerr << "ACMR " << before << " -> " << acmr(indices) << endl;
+
+  for (int vi : order) {
+    auto &v = vertices[vi].v; 
+    out << "v " << v[0] << " " << v[1] << " " << v[2] << "\n"; 
+  }
+  for (int vi : order) {
+    auto &vn = vertices[vi].vn; 
+    out << "vn " << vn[0] << " " << vn[1] << " " << vn[2] << "\n"; 
+  }
+  for (int i = 0; i < (int) indices.size(); i += 3) {
+    out << "f"; 
+    for (int k = 0; k < 3; k++) 
+      out << " " << indices[i + k] + 1 << "//" << indices[i + k] + 1; 
+    out << "\n"; 
   }
-  for (int i = 0; i < vecv.size(); i++)
-    vertices.emplace_back(i, vecv[i], vecn[vnid[i]], fids[i]); 
 }
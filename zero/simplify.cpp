@@ -57,6 +57,13 @@ GarlandHeckbert::GarlandHeckbert (Mesh &mesh) : mesh(mesh) {
   _initializeCandidates(); 
 }
 
+GarlandHeckbert::GarlandHeckbert (Mesh &mesh, const vector<Matrix4f> &Qs, 
+                                  const vector<pair<int, int> > &edges) 
+  : mesh(mesh), Qs(Qs) {
+  for (auto &e : edges) 
+    candidates.emplace(this, e.first, e.second); 
+}
+
 Vector4f GarlandHeckbert::_faceNormal (int fi) {
   // compute the coefficients of the plane made by the fi'th face:
   //    ax + by + cz + d = 0
@@ -75,6 +82,8 @@ void GarlandHeckbert::_computeQuadrics () {
   for (int i = 0; i < n; i++) {
     Qs.emplace_back();
     for (int fi: mesh.vertices[i].faceIds) {
+      if (mesh.invalidFaces.count(fi) > 0) 
+        continue;
       Vector4f fnormal = _faceNormal(fi); 
       Qs.back() = Qs.back() + outer_prod(fnormal, fnormal);  
     }
@@ -84,6 +93,8 @@ void GarlandHeckbert::_computeQuadrics () {
 void GarlandHeckbert::_initializeCandidates () {
   set<pair<int, int> > pairs; 
   for (auto &f: mesh.faces) {
+    if (mesh.invalidFaces.count(f.id) > 0) 
+      continue;
     int csz = f.cornerIds.size();
     for (int i = 0; i < csz; i++) { 
       int v1 = f.cornerIds[i], v2 = f.cornerIds[(1 + i) % csz]; 
@@ -97,7 +108,7 @@ void GarlandHeckbert::_initializeCandidates () {
   }
 }
 
-void GarlandHeckbert::simplifyStep () {
+bool GarlandHeckbert::simplifyStep () {
   auto &vertices = mesh.vertices;
   auto &faces = mesh.faces;
   while (!candidates.empty()) {
@@ -108,6 +119,8 @@ void GarlandHeckbert::simplifyStep () {
     if (mesh.invalidVertices.count(v1) > 0 ||
         mesh.invalidVertices.count(v2) > 0) 
       continue;
+    if (pinned.count(v1) > 0 || pinned.count(v2) > 0) 
+      continue;
     // record faces shared by this candidate
     vector<int> fids;
     // old vertex faces need to be updated.
@@ -159,6 +172,7 @@ void GarlandHeckbert::simplifyStep () {
     // now insert new candidates 
     for (auto &p: newedges) 
       candidates.emplace(this, p.first, p.second); 
-    break; 
+    return true; 
   }
+  return false; 
 }
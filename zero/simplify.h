@@ -7,6 +7,10 @@ using namespace std;
 
 const double INF = DBL_MAX;
 
+Vector3f proj (const Vector4f &x); 
+
+Matrix4f operator + (const Matrix4f& x, const Matrix4f& y); 
+
 struct GarlandHeckbert;
 
 struct Candidate {
@@ -22,15 +26,33 @@ struct GarlandHeckbert {
   Mesh &mesh;
   vector<Matrix4f> Qs;
   set<Candidate> candidates;   
+  // vertices that must not be contracted, eg. seams between
+  // partitions that are being simplified independently.
+  set<int> pinned; 
 
   GarlandHeckbert (Mesh &mesh);
 
+  // start from quadrics that are already known, eg. accumulated
+  // while simplifying parts of the mesh, with only the given 
+  // edges as candidates.
+  GarlandHeckbert (Mesh &mesh, const vector<Matrix4f> &Qs, 
+                   const vector<pair<int, int> > &edges);
+
   void _computeQuadrics(); 
 
   Vector4f _faceNormal(int i); 
 
   void _initializeCandidates(); 
   
-  void simplifyStep (); 
+  // contract the cheapest valid candidate. Returns false 
+  // once there is nothing left to contract.
+  bool simplifyStep (); 
 }; 
 
+// Split the mesh into k spatial slabs, simplify each in its own
+// thread with the seams pinned and stitch the pieces back together.
+// The seams are then simplified serially, reusing the quadrics of
+// the parts, until only `ratio` of the original faces remain. The
+// mesh is left compacted.
+void partitionedSimplify (Mesh &mesh, int k, float ratio); 
+